@@ -173,6 +173,13 @@ HEADERS += src/qt/bitcoingui.h \
     src/version.h \
     src/qt/rpcconsole.h \
     src/diff.h \
+    src/hashmeter.h \
+    src/sigcache.h \
+    src/blockindexstore.h \
+    src/blockcache.h \
+    src/relay.h \
+    src/checkqueue.h \
+    src/workqueue.h \
     src/qt/refunddialog.h
 
 SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
@@ -236,6 +243,11 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/miningpage.cpp \
     src/noui.cpp \
     src/diff.cpp \
+    src/hashmeter.cpp \
+    src/sigcache.cpp \
+    src/blockindexstore.cpp \
+    src/blockcache.cpp \
+    src/relay.cpp \
     src/qt/refunddialog.cpp
 
 RESOURCES += \
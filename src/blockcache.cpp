@@ -0,0 +1,70 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "util.h"
+
+using namespace std;
+
+CBlockCache::CBlockCache(uint64 nMaxBytesIn)
+{
+    nMaxBytes = nMaxBytesIn;
+    nBytes = 0;
+    nHits = 0;
+    nMisses = 0;
+    nEvictions = 0;
+}
+
+bool CBlockCache::Get(const uint256& hash, CSendBuffer& buf)
+{
+    LOCK(cs);
+    MapType::iterator mi = mapBuffer.find(hash);
+    if (mi == mapBuffer.end())
+    {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    listLru.splice(listLru.begin(), listLru, (*mi).second.second);
+    buf = (*mi).second.first;
+    return true;
+}
+
+void CBlockCache::Insert(const uint256& hash, const CSendBuffer& buf)
+{
+    LOCK(cs);
+    if (!buf || buf->size() > nMaxBytes || mapBuffer.count(hash))
+        return;
+
+    while (nBytes + buf->size() > nMaxBytes)
+    {
+        MapType::iterator mi = mapBuffer.find(listLru.back());
+        nBytes -= (*mi).second.first->size();
+        mapBuffer.erase(mi);
+        listLru.pop_back();
+        nEvictions++;
+    }
+
+    listLru.push_front(hash);
+    mapBuffer.insert(make_pair(hash, make_pair(buf, listLru.begin())));
+    nBytes += buf->size();
+}
+
+unsigned int CBlockCache::GetCount()
+{
+    LOCK(cs);
+    return mapBuffer.size();
+}
+
+uint64 CBlockCache::GetSize()
+{
+    LOCK(cs);
+    return nBytes;
+}
+
+CBlockCache& GetBlockCache()
+{
+    static CBlockCache blockCache(max((int64)0, min(GetArg("-blockcachesize", 16), (int64)4096)) << 20);
+    return blockCache;
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include <list>
+#include <map>
+
+#include "net.h"
+#include "sync.h"
+#include "uint256.h"
+
+/** Recently served "block" messages, framed and ready to send.
+ *
+ * Peers bootstrapping at the same time ask for the same blocks, so the
+ * finished message is kept and queued to each of them as a shared buffer.
+ * Entries are evicted least recently used first once their total size
+ * exceeds the byte budget.  A buffer still queued to a peer stays alive
+ * after eviction until that peer has sent it.
+ */
+class CBlockCache
+{
+public:
+    /** Keep up to nMaxBytes of messages; 0 disables the cache */
+    CBlockCache(uint64 nMaxBytes);
+
+    bool Get(const uint256& hash, CSendBuffer& buf);
+    void Insert(const uint256& hash, const CSendBuffer& buf);
+
+    /** Number of messages held */
+    unsigned int GetCount();
+    /** Bytes held */
+    uint64 GetSize();
+    uint64 GetMaxSize() const { return nMaxBytes; }
+
+    // Counters since startup
+    int64 GetHits() const { return nHits; }
+    int64 GetMisses() const { return nMisses; }
+    int64 GetEvictions() const { return nEvictions; }
+
+private:
+    typedef std::list<uint256> LruList;
+    typedef std::map<uint256, std::pair<CSendBuffer, LruList::iterator> > MapType;
+
+    CCriticalSection cs;
+    uint64 nMaxBytes;
+    uint64 nBytes;
+    LruList listLru; // most recently used at the front
+    MapType mapBuffer;
+
+    int64 nHits;
+    int64 nMisses;
+    int64 nEvictions;
+};
+
+/** The cache used for getdata, sized by -blockcachesize on first use */
+CBlockCache& GetBlockCache();
+
+#endif
@@ -0,0 +1,218 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "blockindexstore.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+CBlockIndexStore* pblockindexstore = NULL;
+
+static const char pchStoreMagic[8] = { 'b', 'l', 'k', 'i', 'd', 'x', 'm', 0 };
+static const unsigned int STORE_VERSION = 1;
+
+/** Occupies the first record slot of the file */
+struct CBlockIndexStoreHeader
+{
+    char pchMagic[8];
+    unsigned int nVersion;
+    unsigned int nRecordSize;
+    unsigned int nRecords;
+};
+
+unsigned int CBlockIndexRecord::GetChecksum() const
+{
+    // Only has to catch torn writes, not tampering
+    const unsigned int* p = (const unsigned int*)this;
+    unsigned int nWords = offsetof(CBlockIndexRecord, nChecksum) / sizeof(unsigned int);
+    unsigned int nSum = 0x811c9dc5;
+    for (unsigned int i = 0; i < nWords; i++)
+        nSum = ((nSum << 5) | (nSum >> 27)) ^ (p[i] * 0x9e3779b1);
+    return nSum;
+}
+
+CBlockIndexStore::CBlockIndexStore()
+{
+    pregion = NULL;
+    nCapacity = 0;
+    nRecords = 0;
+}
+
+CBlockIndexStore::~CBlockIndexStore()
+{
+    Close();
+}
+
+CBlockIndexRecord* CBlockIndexStore::GetRecordPtr(unsigned int n) const
+{
+    // Slot 0 is the header
+    return (CBlockIndexRecord*)pregion->get_address() + (n + 1);
+}
+
+const CBlockIndexRecord& CBlockIndexStore::GetRecord(unsigned int n) const
+{
+    assert(n < nRecords);
+    return *GetRecordPtr(n);
+}
+
+void CBlockIndexStore::Unmap()
+{
+    delete pregion;
+    pregion = NULL;
+}
+
+bool CBlockIndexStore::Map(unsigned int nCapacityIn)
+{
+    Unmap();
+    try
+    {
+        uint64 nSize = (uint64)(nCapacityIn + 1) * sizeof(CBlockIndexRecord);
+        if (boost::filesystem::file_size(path) != nSize)
+            boost::filesystem::resize_file(path, nSize);
+        boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_write);
+        pregion = new boost::interprocess::mapped_region(mapping, boost::interprocess::read_write);
+    }
+    catch (std::exception& e)
+    {
+        pregion = NULL;
+        return error("CBlockIndexStore::Map() : %s", e.what());
+    }
+    nCapacity = nCapacityIn;
+    return true;
+}
+
+bool CBlockIndexStore::Open(const boost::filesystem::path& pathIn)
+{
+    LOCK(cs);
+    Close();
+    path = pathIn;
+
+    if (!boost::filesystem::exists(path))
+        boost::filesystem::ofstream(path, ios::out | ios::binary);
+
+    uint64 nSize = boost::filesystem::file_size(path);
+    unsigned int nCapacityFile = nSize / sizeof(CBlockIndexRecord);
+    if (nCapacityFile == 0)
+        return Clear();
+    if (!Map(nCapacityFile - 1))
+        return false;
+
+    CBlockIndexStoreHeader* pheader = (CBlockIndexStoreHeader*)pregion->get_address();
+    if (memcmp(pheader->pchMagic, pchStoreMagic, sizeof(pchStoreMagic)) != 0 ||
+        pheader->nVersion != STORE_VERSION ||
+        pheader->nRecordSize != sizeof(CBlockIndexRecord) ||
+        pheader->nRecords > nCapacity)
+    {
+        printf("CBlockIndexStore::Open() : %s has no valid header, rebuilding\n", path.string().c_str());
+        return Clear();
+    }
+
+    nRecords = pheader->nRecords;
+    if (nRecords > 0 && !GetRecordPtr(nRecords - 1)->IsValid())
+    {
+        printf("CBlockIndexStore::Open() : dropping incomplete last record\n");
+        pheader->nRecords = --nRecords;
+    }
+    for (unsigned int n = 0; n < nRecords; n++)
+    {
+        const CBlockIndexRecord* prec = GetRecordPtr(n);
+        if (!prec->IsValid() || !mapRecord.insert(make_pair(prec->hashBlock, n)).second)
+        {
+            printf("CBlockIndexStore::Open() : record %u is damaged, rebuilding\n", n);
+            return Clear();
+        }
+    }
+    return true;
+}
+
+void CBlockIndexStore::Close()
+{
+    LOCK(cs);
+    Flush();
+    Unmap();
+    nCapacity = 0;
+    nRecords = 0;
+    mapRecord.clear();
+}
+
+void CBlockIndexStore::Flush()
+{
+    LOCK(cs);
+    if (pregion)
+        pregion->flush();
+}
+
+bool CBlockIndexStore::Clear()
+{
+    LOCK(cs);
+    mapRecord.clear();
+    nRecords = 0;
+    if (!Map(max(nCapacity, 1U)))
+        return false;
+
+    CBlockIndexStoreHeader* pheader = (CBlockIndexStoreHeader*)pregion->get_address();
+    memset(pheader, 0, sizeof(CBlockIndexRecord));
+    memcpy(pheader->pchMagic, pchStoreMagic, sizeof(pchStoreMagic));
+    pheader->nVersion = STORE_VERSION;
+    pheader->nRecordSize = sizeof(CBlockIndexRecord);
+    pheader->nRecords = 0;
+    return true;
+}
+
+bool CBlockIndexStore::Reserve(unsigned int nCount)
+{
+    LOCK(cs);
+    if (nCount <= nCapacity)
+        return true;
+    return Map(nCount);
+}
+
+bool CBlockIndexStore::Write(const uint256& hashBlock, const CDiskBlockIndex& blockindex)
+{
+    LOCK(cs);
+    if (!pregion)
+        return false;
+
+    unsigned int n;
+    map<uint256, unsigned int>::iterator mi = mapRecord.find(hashBlock);
+    bool fAppend = (mi == mapRecord.end());
+    if (fAppend)
+    {
+        // Grow by half again, so appends are amortised constant time
+        if (nRecords >= nCapacity && !Map(max(nCapacity + nCapacity / 2, nCapacity + 4096)))
+            return false;
+        n = nRecords;
+    }
+    else
+        n = (*mi).second;
+
+    CBlockIndexRecord* prec = GetRecordPtr(n);
+    prec->hashBlock      = hashBlock;
+    prec->hashPrev       = blockindex.hashPrev;
+    prec->hashNext       = blockindex.hashNext;
+    prec->hashMerkleRoot = blockindex.hashMerkleRoot;
+    prec->nHeight        = blockindex.nHeight;
+    prec->nFile          = blockindex.nFile;
+    prec->nBlockPos      = blockindex.nBlockPos;
+    prec->nVersion       = blockindex.nVersion;
+    prec->nTime          = blockindex.nTime;
+    prec->nBits          = blockindex.nBits;
+    prec->nNonce         = blockindex.nNonce;
+    prec->nChecksum      = prec->GetChecksum();
+
+    // The record is complete before the header counts it
+    if (fAppend)
+    {
+        mapRecord.insert(make_pair(hashBlock, n));
+        nRecords++;
+        ((CBlockIndexStoreHeader*)pregion->get_address())->nRecords = nRecords;
+    }
+    return true;
+}
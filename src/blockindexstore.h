@@ -0,0 +1,92 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKINDEXSTORE_H
+#define BITCOIN_BLOCKINDEXSTORE_H
+
+#include <map>
+
+#include <boost/filesystem/path.hpp>
+
+#include "sync.h"
+#include "uint256.h"
+
+namespace boost { namespace interprocess { class mapped_region; } }
+
+class CDiskBlockIndex;
+
+/** Fixed-size form of a CDiskBlockIndex in blkindex.map.
+ *  Fields are stored in host byte order, like the rest of the data
+ *  directory, and the block hash is kept so loading never rehashes headers.
+ */
+struct CBlockIndexRecord
+{
+    uint256 hashBlock;
+    uint256 hashPrev;
+    uint256 hashNext;
+    uint256 hashMerkleRoot;
+    int nHeight;
+    unsigned int nFile;
+    unsigned int nBlockPos;
+    int nVersion;
+    unsigned int nTime;
+    unsigned int nBits;
+    unsigned int nNonce;
+    unsigned int nChecksum;
+
+    unsigned int GetChecksum() const;
+    bool IsValid() const { return nChecksum == GetChecksum(); }
+};
+
+/** Append-only, memory-mapped copy of the block index (blkindex.map).
+ *
+ * New blocks are appended as fixed records; updates to a known block (its
+ * hashNext changing) overwrite its record in place.  The file is mapped
+ * whole, so LoadBlockIndex can build mapBlockIndex with one sequential pass
+ * over memory instead of a Berkeley DB cursor walk.
+ *
+ * blkindex.dat stays authoritative: every write still goes there as well,
+ * and the map is rebuilt from it whenever it is missing, damaged or behind.
+ * Records carry a checksum; a torn record at the end (a crash during an
+ * append) is dropped, one anywhere else invalidates the whole file.
+ */
+class CBlockIndexStore
+{
+public:
+    CBlockIndexStore();
+    ~CBlockIndexStore();
+
+    /** Map the file at pathIn, creating it if needed.  A damaged file is
+     *  emptied so the caller migrates again. */
+    bool Open(const boost::filesystem::path& pathIn);
+    void Close();
+    void Flush();
+
+    /** Drop all records */
+    bool Clear();
+    /** Make room for nCount records in total */
+    bool Reserve(unsigned int nCount);
+    /** Append or update the record for hashBlock */
+    bool Write(const uint256& hashBlock, const CDiskBlockIndex& blockindex);
+
+    unsigned int GetCount() const { return nRecords; }
+    /** Record n, valid until the next Write, Reserve or Clear */
+    const CBlockIndexRecord& GetRecord(unsigned int n) const;
+
+private:
+    bool Map(unsigned int nCapacityIn);
+    void Unmap();
+    CBlockIndexRecord* GetRecordPtr(unsigned int n) const;
+
+    mutable CCriticalSection cs;
+    boost::filesystem::path path;
+    boost::interprocess::mapped_region* pregion;
+    unsigned int nCapacity;
+    unsigned int nRecords;
+    std::map<uint256, unsigned int> mapRecord;
+};
+
+/** Open when -mmapblockindex is set, NULL otherwise */
+extern CBlockIndexStore* pblockindexstore;
+
+#endif
@@ -7,6 +7,7 @@
 #include "db.h"
 #include "util.h"
 #include "main.h"
+#include "blockindexstore.h"
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -28,6 +29,7 @@ unsigned int nWalletDBUpdated;
 //
 
 CDBEnv bitdb;
+CDBBatch txdbbatch;
 
 void CDBEnv::EnvShutdown()
 {
@@ -84,8 +86,8 @@ bool CDBEnv::Open(boost::filesystem::path pathEnv_)
     dbenv.set_cachesize(nDbCache / 1024, (nDbCache % 1024)*1048576, 1);
     dbenv.set_lg_bsize(1048576);
     dbenv.set_lg_max(10485760);
-    dbenv.set_lk_max_locks(10000);
-    dbenv.set_lk_max_objects(10000);
+    dbenv.set_lk_max_locks(40000);
+    dbenv.set_lk_max_objects(40000);
     dbenv.set_errfile(fopen(pathErrorFile.string().c_str(), "a")); /// debug
     dbenv.set_flags(DB_AUTO_COMMIT, 1);
     dbenv.set_flags(DB_TXN_WRITE_NOSYNC, 1);
@@ -115,7 +117,7 @@ void CDBEnv::CheckpointLSN(std::string strFile)
 
 
 CDB::CDB(const char *pszFile, const char* pszMode) :
-    pdb(NULL), activeTxn(NULL)
+    pdb(NULL), activeTxn(NULL), pbatch(NULL), fTxnBatch(false)
 {
     int ret;
     if (pszFile == NULL)
@@ -186,6 +188,8 @@ void CDB::Close()
     if (activeTxn)
         activeTxn->abort();
     activeTxn = NULL;
+    mapTxnWrites.clear();
+    fTxnBatch = false;
     pdb = NULL;
 
     // Flush database activity from memory pool to disk log
@@ -205,6 +209,42 @@ void CDB::Close()
     }
 }
 
+int CDB::GetBatched(const string& strKey, string& strValue)
+{
+    if (fTxnBatch)
+    {
+        CDBBatch::MapType::const_iterator mi = mapTxnWrites.find(strKey);
+        if (mi != mapTxnWrites.end())
+        {
+            if ((*mi).second.fErase)
+                return 0;
+            strValue = (*mi).second.strValue;
+            return 1;
+        }
+    }
+    return pbatch->Get(strKey, strValue);
+}
+
+void CDB::PutBatched(const string& strKey, bool fErase, const string& strValue)
+{
+    if (fReadOnly)
+        assert(!"Write called on database in read-only mode");
+
+    CDBBatch::CEntry entry;
+    entry.fErase = fErase;
+    entry.strValue = strValue;
+    if (fTxnBatch)
+    {
+        mapTxnWrites[strKey] = entry;
+    }
+    else
+    {
+        CDBBatch::MapType mapWrite;
+        mapWrite[strKey] = entry;
+        pbatch->Commit(mapWrite);
+    }
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
@@ -364,6 +404,119 @@ void CDBEnv::Flush(bool fShutdown)
 
 
 
+//
+// CDBBatch
+//
+
+CDBBatch::CDBBatch()
+{
+    nBlocksPending = 0;
+    nBlocksIBD = 0;
+    nBlocks = 0;
+}
+
+void CDBBatch::SetLimits(int nBlocksIBDIn, int nBlocksIn)
+{
+    LOCK(cs);
+    nBlocks = max(nBlocksIn, 0);
+    nBlocksIBD = (nBlocks > 0 ? max(nBlocksIBDIn, 1) : 0);
+}
+
+int CDBBatch::Get(const string& strKey, string& strValue)
+{
+    LOCK(cs);
+    MapType::const_iterator mi = mapWrites.find(strKey);
+    if (mi == mapWrites.end())
+        return -1;
+    if ((*mi).second.fErase)
+        return 0;
+    strValue = (*mi).second.strValue;
+    return 1;
+}
+
+void CDBBatch::Commit(const MapType& mapTxnWrites)
+{
+    LOCK(cs);
+    BOOST_FOREACH(const MapType::value_type& item, mapTxnWrites)
+        mapWrites[item.first] = item.second;
+}
+
+void CDBBatch::BlockConnected()
+{
+    LOCK(cs);
+    nBlocksPending++;
+}
+
+bool CDBBatch::IsFlushDue(bool fForce, bool fInitialDownload)
+{
+    LOCK(cs);
+    if (mapWrites.empty())
+        return false;
+    if (fForce || mapWrites.size() >= MAX_RECORDS)
+        return true;
+    return nBlocksPending >= (fInitialDownload ? nBlocksIBD : nBlocks);
+}
+
+bool CDBBatch::Flush(Db* pdb)
+{
+    LOCK(cs);
+    if (mapWrites.empty())
+        return true;
+
+    int64 nStart = GetTimeMillis();
+    DbTxn* ptxn = bitdb.TxnBegin();
+    if (!ptxn)
+        return error("CDBBatch::Flush() : TxnBegin failed");
+
+    // The map is in key order, which is the btree's order as well
+    BOOST_FOREACH(const MapType::value_type& item, mapWrites)
+    {
+        Dbt datKey((void*)item.first.data(), item.first.size());
+        int ret;
+        if (item.second.fErase)
+        {
+            ret = pdb->del(ptxn, &datKey, 0);
+            if (ret == DB_NOTFOUND)
+                ret = 0;
+        }
+        else
+        {
+            Dbt datValue((void*)item.second.strValue.data(), item.second.strValue.size());
+            ret = pdb->put(ptxn, &datKey, &datValue, 0);
+        }
+        if (ret != 0)
+        {
+            ptxn->abort();
+            return error("CDBBatch::Flush() : write failed (%d)", ret);
+        }
+    }
+    if (ptxn->commit(0) != 0)
+        return error("CDBBatch::Flush() : TxnCommit failed");
+
+    if (fDebug)
+        printf("CDBBatch::Flush() : wrote %u records for %d blocks in %"PRI64d"ms\n", (unsigned int)mapWrites.size(), nBlocksPending, GetTimeMillis() - nStart);
+    mapWrites.clear();
+    nBlocksPending = 0;
+    return true;
+}
+
+unsigned int CDBBatch::GetSize()
+{
+    LOCK(cs);
+    return mapWrites.size();
+}
+
+int CDBBatch::GetBlockCount()
+{
+    LOCK(cs);
+    return nBlocksPending;
+}
+
+
+
+
+
+
 //
 // CTxDB
 //
@@ -431,9 +584,27 @@ bool CTxDB::ReadDiskTx(COutPoint outpoint, CTransaction& tx)
     return ReadDiskTx(outpoint.hash, tx, txindex);
 }
 
+bool CTxDB::ReadCoins(uint256 hash, CCoins& coins)
+{
+    return Read(make_pair(string("coins"), hash), coins);
+}
+
+bool CTxDB::WriteCoins(uint256 hash, const CCoins& coins)
+{
+    return Write(make_pair(string("coins"), hash), coins);
+}
+
+bool CTxDB::EraseCoins(uint256 hash)
+{
+    return Erase(make_pair(string("coins"), hash));
+}
+
 bool CTxDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
 {
-    return Write(make_pair(string("blockindex"), blockindex.GetBlockHash()), blockindex);
+    uint256 hash = blockindex.GetBlockHash();
+    if (pblockindexstore && !pblockindexstore->Write(hash, blockindex))
+        return error("CTxDB::WriteBlockIndex() : writing blkindex.map failed");
+    return Write(make_pair(string("blockindex"), hash), blockindex);
 }
 
 bool CTxDB::ReadHashBestChain(uint256& hashBestChain)
@@ -456,6 +627,35 @@ bool CTxDB::WriteBestInvalidWork(CBigNum bnBestInvalidWork)
     return Write(string("bnBestInvalidWork"), bnBestInvalidWork);
 }
 
+bool CTxDB::ReadBlockFileReplayPos(unsigned int& nFile, unsigned int& nBlockPos)
+{
+    pair<unsigned int, unsigned int> pos;
+    if (!Read(string("blkreplaypos"), pos))
+        return false;
+    nFile = pos.first;
+    nBlockPos = pos.second;
+    return true;
+}
+
+bool CTxDB::WriteBlockFileReplayPos(unsigned int nFile, unsigned int nBlockPos)
+{
+    return Write(string("blkreplaypos"), make_pair(nFile, nBlockPos));
+}
+
+bool CTxDB::EraseBlockFileReplayPos()
+{
+    return Erase(string("blkreplaypos"));
+}
+
+bool CTxDB::FlushBatch()
+{
+    if (!pbatch)
+        return true;
+    if (fTxnBatch)
+        return error("CTxDB::FlushBatch() : transaction still open");
+    return pbatch->Flush(pdb);
+}
+
 CBlockIndex static * InsertBlockIndex(uint256 hash)
 {
     if (hash == 0)
@@ -476,10 +676,47 @@ CBlockIndex static * InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+void static UnloadBlockIndex()
+{
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        delete item.second;
+    mapBlockIndex.clear();
+    pindexGenesisBlock = NULL;
+}
+
 bool CTxDB::LoadBlockIndex()
 {
-    if (!LoadBlockIndexGuts())
-        return false;
+    // Prefer the memory-mapped copy of the index.  Fall back to, and
+    // migrate from, blkindex.dat when it is empty or doesn't match.
+    bool fFromStore = false;
+    if (pblockindexstore && pblockindexstore->GetCount() > 0)
+    {
+        fFromStore = LoadBlockIndexStore();
+        if (!fFromStore)
+        {
+            printf("LoadBlockIndex() : blkindex.map is out of date, rebuilding it from blkindex.dat\n");
+            UnloadBlockIndex();
+            if (!pblockindexstore->Clear())
+                return false;
+        }
+    }
+    if (!fFromStore)
+    {
+        if (!LoadBlockIndexGuts())
+            return false;
+
+        if (pblockindexstore && !fRequestShutdown)
+        {
+            int64 nStart = GetTimeMillis();
+            if (!pblockindexstore->Reserve(mapBlockIndex.size()))
+                return false;
+            BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+                if (!pblockindexstore->Write(item.first, CDiskBlockIndex(item.second)))
+                    return error("LoadBlockIndex() : writing blkindex.map failed");
+            pblockindexstore->Flush();
+            printf("LoadBlockIndex(): copied %u entries to blkindex.map in %"PRI64d"ms\n", (unsigned int)mapBlockIndex.size(), GetTimeMillis() - nStart);
+        }
+    }
 
     if (fRequestShutdown)
         return true;
@@ -510,6 +747,16 @@ bool CTxDB::LoadBlockIndex()
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
     pindexBest = mapBlockIndex[hashBestChain];
     nBestHeight = pindexBest->nHeight;
+
+    // hashNext in blkindex.map is written outside the database transaction
+    // and may be stale, so link the best chain from hashBestChain instead
+    if (fFromStore)
+    {
+        pindexBest->pnext = NULL;
+        for (CBlockIndex* pindex = pindexBest; pindex->pprev; pindex = pindex->pprev)
+            pindex->pprev->pnext = pindex;
+    }
+
     bnBestChainWork = pindexBest->bnChainWork;
     printf("LoadBlockIndex(): hashBestChain=%s  height=%d  date=%s\n",
       hashBestChain.ToString().substr(0,20).c_str(), nBestHeight,
@@ -648,6 +895,48 @@ bool CTxDB::LoadBlockIndex()
 
 
 
+bool CTxDB::LoadBlockIndexStore()
+{
+    int64 nStart = GetTimeMillis();
+    unsigned int nCount = pblockindexstore->GetCount();
+    for (unsigned int n = 0; n < nCount && !fRequestShutdown; n++)
+    {
+        const CBlockIndexRecord& rec = pblockindexstore->GetRecord(n);
+
+        // Construct block index object
+        CBlockIndex* pindexNew = InsertBlockIndex(rec.hashBlock);
+        pindexNew->pprev          = InsertBlockIndex(rec.hashPrev);
+        pindexNew->nFile          = rec.nFile;
+        pindexNew->nBlockPos      = rec.nBlockPos;
+        pindexNew->nHeight        = rec.nHeight;
+        pindexNew->nVersion       = rec.nVersion;
+        pindexNew->hashMerkleRoot = rec.hashMerkleRoot;
+        pindexNew->nTime          = rec.nTime;
+        pindexNew->nBits          = rec.nBits;
+        pindexNew->nNonce         = rec.nNonce;
+
+        // Watch for genesis block
+        if (pindexGenesisBlock == NULL && rec.hashBlock == hashGenesisBlock)
+            pindexGenesisBlock = pindexNew;
+
+        if (!pindexNew->CheckIndex())
+            return error("LoadBlockIndexStore() : CheckIndex failed at %d", pindexNew->nHeight);
+    }
+    if (fRequestShutdown)
+        return true;
+
+    // Every parent needs a record of its own, and the best chain recorded
+    // in blkindex.dat has to be here, or some appends never reached the disk
+    if (mapBlockIndex.size() != nCount)
+        return error("LoadBlockIndexStore() : %u blocks referenced, %u stored", (unsigned int)mapBlockIndex.size(), nCount);
+    uint256 hashBest;
+    if (ReadHashBestChain(hashBest) && !mapBlockIndex.count(hashBest))
+        return error("LoadBlockIndexStore() : best chain %s missing", hashBest.ToString().substr(0,20).c_str());
+
+    printf("LoadBlockIndex(): %u entries from blkindex.map in %"PRI64d"ms\n", nCount, GetTimeMillis() - nStart);
+    return true;
+}
+
 bool CTxDB::LoadBlockIndexGuts()
 {
     // Get database cursor
@@ -17,6 +17,7 @@
 class CAddress;
 class CAddrMan;
 class CBlockLocator;
+class CCoins;
 class CDiskBlockIndex;
 class CDiskTxPos;
 class CMasterKey;
@@ -70,6 +71,55 @@ public:
 extern CDBEnv bitdb;
 
 
+/** Write-behind cache for blkindex.dat.
+ *
+ * While enabled, committed CTxDB transactions land here instead of going to
+ * Berkeley DB one by one.  Flush then writes everything gathered over
+ * several blocks in a single transaction, in key order, so the btree sees
+ * one sequential pass and the log one commit.  Reads through any CTxDB look
+ * here first.  Cursor walks don't, which is fine as they only run at startup
+ * before anything is batched.
+ */
+class CDBBatch
+{
+public:
+    struct CEntry
+    {
+        bool fErase;
+        std::string strValue;
+    };
+    typedef std::map<std::string, CEntry> MapType;
+
+    // Every record takes a page lock in the flush transaction
+    static const unsigned int MAX_RECORDS = 10000;
+
+    CDBBatch();
+
+    /** Blocks per commit during initial download and once synced, 0 disables batching */
+    void SetLimits(int nBlocksIBDIn, int nBlocksIn);
+    bool IsEnabled() const { return nBlocks > 0; }
+
+    /** 1 if strKey has a pending value, 0 if it is pending erase, -1 if not batched */
+    int Get(const std::string& strKey, std::string& strValue);
+    void Commit(const MapType& mapTxnWrites);
+    void BlockConnected();
+    bool IsFlushDue(bool fForce, bool fInitialDownload);
+    bool Flush(Db* pdb);
+
+    unsigned int GetSize();
+    int GetBlockCount();
+
+private:
+    CCriticalSection cs;
+    MapType mapWrites;
+    int nBlocksPending;
+    int nBlocksIBD;
+    int nBlocks;
+};
+
+extern CDBBatch txdbbatch;
+
+
 /** RAII class that provides access to a Berkeley database */
 class CDB
 {
@@ -78,6 +128,9 @@ protected:
     std::string strFile;
     DbTxn *activeTxn;
     bool fReadOnly;
+    CDBBatch* pbatch;
+    bool fTxnBatch;
+    CDBBatch::MapType mapTxnWrites;
 
     explicit CDB(const char* pszFile, const char* pszMode="r+");
     ~CDB() { Close(); }
@@ -87,6 +140,9 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    int GetBatched(const std::string& strKey, std::string& strValue);
+    void PutBatched(const std::string& strKey, bool fErase, const std::string& strValue);
+
 protected:
     template<typename K, typename T>
     bool Read(const K& key, T& value)
@@ -98,6 +154,26 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        // Pending write-behind value
+        if (pbatch)
+        {
+            std::string strValue;
+            int nBatched = GetBatched(std::string(ssKey.begin(), ssKey.end()), strValue);
+            if (nBatched == 0)
+                return false;
+            if (nBatched > 0)
+            {
+                try {
+                    CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+                    ssValue >> value;
+                }
+                catch (std::exception &e) {
+                    return false;
+                }
+                return true;
+            }
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
@@ -141,6 +217,14 @@ protected:
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        if (pbatch)
+        {
+            if (!fOverwrite && Exists(key))
+                return false;
+            PutBatched(std::string(ssKey.begin(), ssKey.end()), false, std::string(ssValue.begin(), ssValue.end()));
+            return true;
+        }
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
@@ -164,6 +248,12 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (pbatch)
+        {
+            PutBatched(std::string(ssKey.begin(), ssKey.end()), true, std::string());
+            return true;
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
@@ -184,6 +274,14 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (pbatch)
+        {
+            std::string strValue;
+            int nBatched = GetBatched(std::string(ssKey.begin(), ssKey.end()), strValue);
+            if (nBatched >= 0)
+                return (nBatched > 0);
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
@@ -247,8 +345,14 @@ protected:
 public:
     bool TxnBegin()
     {
-        if (!pdb || activeTxn)
+        if (!pdb || activeTxn || fTxnBatch)
             return false;
+        if (pbatch)
+        {
+            // Staged here until TxnCommit hands it to the batch
+            fTxnBatch = true;
+            return true;
+        }
         DbTxn* ptxn = bitdb.TxnBegin();
         if (!ptxn)
             return false;
@@ -258,6 +362,13 @@ public:
 
     bool TxnCommit()
     {
+        if (pdb && fTxnBatch)
+        {
+            pbatch->Commit(mapTxnWrites);
+            mapTxnWrites.clear();
+            fTxnBatch = false;
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -267,6 +378,12 @@ public:
 
     bool TxnAbort()
     {
+        if (pdb && fTxnBatch)
+        {
+            mapTxnWrites.clear();
+            fTxnBatch = false;
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -298,7 +415,11 @@ public:
 class CTxDB : public CDB
 {
 public:
-    CTxDB(const char* pszMode="r+") : CDB("blkindex.dat", pszMode) { }
+    CTxDB(const char* pszMode="r+") : CDB("blkindex.dat", pszMode)
+    {
+        if (txdbbatch.IsEnabled())
+            pbatch = &txdbbatch;
+    }
 private:
     CTxDB(const CTxDB&);
     void operator=(const CTxDB&);
@@ -312,14 +433,22 @@ public:
     bool ReadDiskTx(uint256 hash, CTransaction& tx);
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx, CTxIndex& txindex);
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx);
+    bool ReadCoins(uint256 hash, CCoins& coins);
+    bool WriteCoins(uint256 hash, const CCoins& coins);
+    bool EraseCoins(uint256 hash);
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
     bool ReadHashBestChain(uint256& hashBestChain);
     bool WriteHashBestChain(uint256 hashBestChain);
     bool ReadBestInvalidWork(CBigNum& bnBestInvalidWork);
     bool WriteBestInvalidWork(CBigNum bnBestInvalidWork);
+    bool ReadBlockFileReplayPos(unsigned int& nFile, unsigned int& nBlockPos);
+    bool WriteBlockFileReplayPos(unsigned int nFile, unsigned int nBlockPos);
+    bool EraseBlockFileReplayPos();
+    bool FlushBatch();
     bool LoadBlockIndex();
 private:
     bool LoadBlockIndexGuts();
+    bool LoadBlockIndexStore();
 };
 
 
@@ -0,0 +1,139 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hashmeter.h"
+#include "sync.h"
+
+using namespace std;
+
+// 64-bit loads and stores are not atomic on every platform we build for,
+// so go through the locked builtins.  Only readers and the once-a-second
+// samples pay for it.
+static inline int64 AtomicRead(const volatile int64* p)
+{
+    return __sync_add_and_fetch(const_cast<volatile int64*>(p), 0);
+}
+
+static inline void AtomicWrite(volatile int64* p, int64 n)
+{
+    int64 nOld = *p;
+    int64 nPrev;
+    while ((nPrev = __sync_val_compare_and_swap(p, nOld, n)) != nOld)
+        nOld = nPrev;
+}
+
+CHashMeter::CHashMeter()
+{
+    Reset(0);
+}
+
+void CHashMeter::Reset(int64 nNow)
+{
+    AtomicWrite(&nHashes, 0);
+    for (int i = 0; i < SAMPLES; i++)
+    {
+        AtomicWrite(&anSampleTime[i], -1);
+        AtomicWrite(&anSampleHashes[i], 0);
+    }
+    nLastSecond = -1;
+    Add(0, nNow);
+}
+
+void CHashMeter::Add(unsigned int nHashesDone, int64 nNow)
+{
+    int64 nTotal = __sync_add_and_fetch(&nHashes, (int64)nHashesDone);
+
+    int64 nSecond = nNow / 1000;
+    if (nSecond == nLastSecond)
+        return;
+    nLastSecond = nSecond;
+
+    // Invalidate the slot while it is rewritten so a reader never pairs
+    // a new time with an old count
+    int i = nSecond % SAMPLES;
+    AtomicWrite(&anSampleTime[i], -1);
+    AtomicWrite(&anSampleHashes[i], nTotal);
+    AtomicWrite(&anSampleTime[i], nNow);
+}
+
+int64 CHashMeter::GetTotal() const
+{
+    return AtomicRead(&nHashes);
+}
+
+double CHashMeter::GetRate(int nWindow, int64 nNow) const
+{
+    int64 nTotal = AtomicRead(&nHashes);
+    int64 nNowSecond = nNow / 1000;
+    if (nWindow > SAMPLES - 2)
+        nWindow = SAMPLES - 2;
+
+    // Use the oldest sample inside the window
+    for (int64 nSecond = nNowSecond - nWindow; nSecond < nNowSecond; nSecond++)
+    {
+        if (nSecond < 0)
+            continue;
+        int i = nSecond % SAMPLES;
+        int64 nTime = AtomicRead(&anSampleTime[i]);
+        if (nTime < 0 || nTime / 1000 != nSecond)
+            continue;
+        int64 nThen = AtomicRead(&anSampleHashes[i]);
+        if (AtomicRead(&anSampleTime[i]) != nTime)
+            continue;
+        if (nNow <= nTime || nTotal < nThen)
+            return 0;
+        return 1000.0 * (nTotal - nThen) / (nNow - nTime);
+    }
+    return 0;
+}
+
+
+static CCriticalSection cs_vHashMeters;
+static CHashMeter* apHashMeters[MAX_MINER_THREADS];
+static volatile bool afHashMeterActive[MAX_MINER_THREADS];
+
+CHashMeter* ClaimHashMeter(int& nSlot)
+{
+    LOCK(cs_vHashMeters);
+    for (nSlot = 0; nSlot < MAX_MINER_THREADS; nSlot++)
+    {
+        if (afHashMeterActive[nSlot])
+            continue;
+        // Meters are never freed, so readers can walk the array unlocked
+        if (!apHashMeters[nSlot])
+            apHashMeters[nSlot] = new CHashMeter();
+        apHashMeters[nSlot]->Reset(GetTimeMillis());
+        __sync_synchronize();
+        afHashMeterActive[nSlot] = true;
+        return apHashMeters[nSlot];
+    }
+    nSlot = -1;
+    return NULL;
+}
+
+void ReleaseHashMeter(int nSlot)
+{
+    LOCK(cs_vHashMeters);
+    if (nSlot >= 0 && nSlot < MAX_MINER_THREADS)
+        afHashMeterActive[nSlot] = false;
+}
+
+double GetHashesPerSec(int nWindow, vector<double>* pvThreadRates)
+{
+    int64 nNow = GetTimeMillis();
+    double dTotal = 0;
+    if (pvThreadRates)
+        pvThreadRates->clear();
+    for (int i = 0; i < MAX_MINER_THREADS; i++)
+    {
+        if (!afHashMeterActive[i])
+            continue;
+        __sync_synchronize();
+        double dRate = apHashMeters[i]->GetRate(nWindow, nNow);
+        dTotal += dRate;
+        if (pvThreadRates)
+            pvThreadRates->push_back(dRate);
+    }
+    return dTotal;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_HASHMETER_H
+#define BITCOIN_HASHMETER_H
+
+#include <vector>
+
+#include "util.h"
+
+/** Hash rate windows reported by gethashespersec and getmininginfo, in seconds */
+static const int HASHMETER_WINDOW_1S = 1;
+static const int HASHMETER_WINDOW_60S = 60;
+static const int HASHMETER_WINDOW_15M = 15 * 60;
+
+/** Most miner threads that can be metered at once */
+static const int MAX_MINER_THREADS = 256;
+
+/** Hash counter of one miner thread.
+ *
+ * Only the owning thread writes to a meter, so counting never contends with
+ * other miners.  Once a second the owner records its running total in a ring
+ * of per-second samples; readers compute windowed rates from the ring
+ * without taking a lock.  The hot counter sits on its own cache line.
+ */
+class CHashMeter
+{
+public:
+    /** One sample per second, enough to cover the longest window */
+    enum { SAMPLES = 1024 };
+
+    CHashMeter();
+
+    /** Start counting from zero at nNow (milliseconds) */
+    void Reset(int64 nNow);
+    /** Count nHashesDone hashes finished at nNow (milliseconds), owner thread only */
+    void Add(unsigned int nHashesDone, int64 nNow);
+    /** Hashes counted since the last Reset */
+    int64 GetTotal() const;
+    /** Hashes per second over the last nWindow seconds, or over the meter's
+     *  lifetime if it is younger than that */
+    double GetRate(int nWindow, int64 nNow) const;
+
+private:
+    char pchPadding0[64];
+    volatile int64 nHashes;
+    int64 nLastSecond;
+    char pchPadding1[64];
+    volatile int64 anSampleTime[SAMPLES];
+    volatile int64 anSampleHashes[SAMPLES];
+};
+
+/** Claim the meter of the lowest free miner slot and reset it, NULL if all
+ *  MAX_MINER_THREADS slots are taken */
+CHashMeter* ClaimHashMeter(int& nSlot);
+/** Give a slot back when its miner thread exits */
+void ReleaseHashMeter(int nSlot);
+/** Summed hashes per second of all running miner threads over nWindow
+ *  seconds, optionally with the rate of each thread in slot order */
+double GetHashesPerSec(int nWindow, std::vector<double>* pvThreadRates = NULL);
+
+#endif
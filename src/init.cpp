@@ -4,6 +4,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include "db.h"
+#include "blockindexstore.h"
 #include "walletdb.h"
 #include "bitcoinrpc.h"
 #include "net.h"
@@ -73,8 +74,17 @@ void Shutdown(void* parg)
         fShutdown = true;
         nTransactionsUpdated++;
         bitdb.Flush(false);
+        StopScriptCheckThreads();
         StopNode();
+        {
+            LOCK(cs_main);
+            CTxDB txdb;
+            coinscache.Flush(txdb, true);
+            FlushBlockIndexBatch(txdb, true);
+        }
         bitdb.Flush(true);
+        if (pblockindexstore)
+            pblockindexstore->Close();
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
         delete pwalletMain;
@@ -224,9 +234,17 @@ std::string HelpMessage()
         "  -pid=<file>            " + _("Specify pid file (default: Noirbits.pid)") + "\n" +
         "  -gen                   " + _("Generate coins") + "\n" +
         "  -gen=0                 " + _("Don't generate coins") + "\n" +
+        "  -mineraffinity         " + _("Pin each mining thread to its own core (default: 1)") + "\n" +
         "  -datadir=<dir>         " + _("Specify data directory") + "\n" +
-        "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n" +
+        "  -dbcache=<n>           " + _("Set database and unspent output cache sizes in megabytes (default: 25)") + "\n" +
+        "  -par=N                 " + _("Set the number of script verification threads (up to 16, 0 = auto, <0 = leave that many cores free, default: 0)") + "\n" +
+        "  -mmapblockindex        " + _("Keep a memory-mapped copy of the block index for faster startup (default: 0)") + "\n" +
+        "  -maxsigcachesize=<n>   " + _("Keep at most <n> valid signatures in memory (default: 50000)") + "\n" +
+        "  -blockcachesize=<n>    " + _("Keep up to <n> megabytes of recently requested blocks ready to send to peers, 0 to read every request from disk (default: 16)") + "\n" +
+        "  -relaypoolsize=<n>     " + _("Keep up to <n> megabytes of relayed transactions for peers to fetch (default: 32)") + "\n" +
         "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n" +
+        "  -dbbatch=<n>           " + _("Commit block index changes every <n> blocks once synced, 0 to write through (default: 1)") + "\n" +
+        "  -dbbatchibd=<n>        " + _("Commit block index changes every <n> blocks during initial download (default: 500)") + "\n" +
         "  -timeout=<n>           " + _("Specify connection timeout (in milliseconds)") + "\n" +
         "  -proxy=<ip:port>       " + _("Connect through socks proxy") + "\n" +
         "  -socks=<n>             " + _("Select the version of socks proxy to use (4-5, default: 5)") + "\n" +
@@ -234,6 +252,9 @@ std::string HelpMessage()
         "  -dns                   " + _("Allow DNS lookups for -addnode, -seednode and -connect") + "\n" +
         "  -port=<port>           " + _("Listen for connections on <port> (default: 14014 or testnet: 44444)") + "\n" +
         "  -maxconnections=<n>    " + _("Maintain at most <n> connections to peers (default: 125)") + "\n" +
+#ifdef __linux__
+        "  -epoll                 " + _("Watch peer sockets with epoll instead of select, for thousands of connections (default: 1)") + "\n" +
+#endif
         "  -addnode=<ip>          " + _("Add a node to connect to and attempt to keep the connection open") + "\n" +
         "  -connect=<ip>          " + _("Connect only to the specified node(s)") + "\n" +
         "  -seednode=<ip>         " + _("Connect to a node to retrieve peer addresses, and disconnect") + "\n" +
@@ -244,6 +265,9 @@ std::string HelpMessage()
         "  -listen                " + _("Accept connections from outside (default: 1 if no -proxy or -connect)") + "\n" +
         "  -bind=<addr>           " + _("Bind to given address. Use [host]:port notation for IPv6") + "\n" +
         "  -dnsseed               " + _("Find peers using DNS lookup (default: 1 unless -connect)") + "\n" +
+        "  -msgthreads=<n>        " + _("Number of threads handling peer messages; the first keeps answering pings and requests while the others validate (default: 2)") + "\n" +
+        "  -headersfirst          " + _("Download block headers first, then blocks from several peers at once (default: 1)") + "\n" +
+        "  -compactblocks         " + _("Send and receive new blocks as short transaction ids to peers that support it (default: 1)") + "\n" +
         "  -banscore=<n>          " + _("Threshold for disconnecting misbehaving peers (default: 100)") + "\n" +
         "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n" +
         "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n" +
@@ -252,6 +276,8 @@ std::string HelpMessage()
         "  -detachdb              " + _("Detach block and address databases. Increases shutdown time (default: 0)") + "\n" +
         "  -paytxfee=<amt>        " + _("Fee per KB to add to transactions you send") + "\n" +
         "  -mininput=<amt>        " + _("When creating transactions, ignore inputs with value less than this (default: 0.0001)") + "\n" +
+        "  -consolidate           " + _("Sweep small outputs of the wallet together while the network is quiet (default: 0)") + "\n" +
+        "  -consolidatethreshold=<amt> " + _("Sweep outputs with value less than this (default: 1)") + "\n" +
 #ifdef QT_GUI
         "  -server                " + _("Accept command line and JSON-RPC commands") + "\n" +
 #endif
@@ -270,6 +296,8 @@ std::string HelpMessage()
         "  -rpcpassword=<pw>      " + _("Password for JSON-RPC connections") + "\n" +
         "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 14014)") + "\n" +
         "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n" +
+        "  -rpcthreads=<n>        " + _("Set the number of threads to service RPC calls (default: 4)") + "\n" +
+        "  -rpcworkqueue=<n>      " + _("Turn RPC calls away once <n> are waiting for a thread (default: 64)") + "\n" +
         "  -rpcconnect=<ip>       " + _("Send commands to node running on <ip> (default: 127.0.0.1)") + "\n" +
         "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n" +
         "  -upgradewallet         " + _("Upgrade wallet to latest format") + "\n" +
@@ -373,6 +401,20 @@ bool AppInit2()
         fDebugNet = GetBoolArg("-debugnet");
 
     bitdb.SetDetach(GetBoolArg("-detachdb", false));
+    coinscache.SetMaxSize(GetArg("-dbcache", 25) << 20);
+    txdbbatch.SetLimits(GetArg("-dbbatchibd", 500), GetArg("-dbbatch", 1));
+    fHeadersFirst = GetBoolArg("-headersfirst", true);
+    if (GetBoolArg("-compactblocks", true))
+        nLocalServices |= NODE_COMPACT_BLOCKS;
+
+    // -par=0 means autodetect, negative values leave that many cores free
+    nScriptCheckThreads = GetArg("-par", 0);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
 #if !defined(WIN32) && !defined(QT_GUI)
     fDaemon = GetBoolArg("-daemon");
@@ -465,6 +507,15 @@ bool AppInit2()
     if (fDaemon)
         fprintf(stdout, "Noirbits server starting\n");
 
+    // The thread connecting a block verifies scripts too, so start one less
+    if (nScriptCheckThreads)
+    {
+        printf("Using %d threads for script verification\n", nScriptCheckThreads);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            if (!CreateThread(ThreadScriptCheck, NULL))
+                printf("Error: CreateThread(ThreadScriptCheck) failed\n");
+    }
+
     int64 nStart;
 
     // ********************************************************* Step 5: network initialization
@@ -575,6 +626,22 @@ bool AppInit2()
         return false;
     }
 
+    // blkindex.map is only kept up to date while it is in use; drop it
+    // otherwise so a later -mmapblockindex migrates afresh
+    boost::filesystem::path pathBlockIndexStore = GetDataDir() / "blkindex.map";
+    if (GetBoolArg("-mmapblockindex"))
+    {
+        pblockindexstore = new CBlockIndexStore();
+        if (!pblockindexstore->Open(pathBlockIndexStore))
+        {
+            printf("Error opening blkindex.map, using blkindex.dat only\n");
+            delete pblockindexstore;
+            pblockindexstore = NULL;
+        }
+    }
+    else if (boost::filesystem::exists(pathBlockIndexStore))
+        boost::filesystem::remove(pathBlockIndexStore);
+
     uiInterface.InitMessage(_("Loading block index..."));
     printf("Loading block index...\n");
     nStart = GetTimeMillis();
@@ -704,6 +771,13 @@ bool AppInit2()
 
     RegisterWallet(pwalletMain);
 
+    pwalletMain->consolidation.fEnabled = GetBoolArg("-consolidate");
+    if (mapArgs.count("-consolidatethreshold"))
+    {
+        if (!ParseMoney(mapArgs["-consolidatethreshold"], pwalletMain->consolidation.nMaxInputValue))
+            return InitError(strprintf(_("Invalid amount for -consolidatethreshold=<amount>: '%s'"), mapArgs["-consolidatethreshold"].c_str()));
+    }
+
     CBlockIndex *pindexRescan = pindexBest;
     if (GetBoolArg("-rescan"))
         pindexRescan = pindexGenesisBlock;
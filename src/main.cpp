@@ -5,11 +5,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "checkpoints.h"
+#include "hashmeter.h"
 #include "diff.h"
 #include "db.h"
 #include "net.h"
 #include "init.h"
 #include "ui_interface.h"
+#include "checkqueue.h"
+#include "blockcache.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -27,6 +30,9 @@ set<CWallet*> setpwalletRegistered;
 CCriticalSection cs_main;
 
 CTxMemPool mempool;
+int nScriptCheckThreads = 0;
+CCoinsCache coinscache;
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 unsigned int nTransactionsUpdated = 0;
 
 map<uint256, CBlockIndex*> mapBlockIndex;
@@ -45,6 +51,32 @@ CMedianFilter<int> cPeerBlockCounts(5, 0); // Amount of blocks that other nodes
 map<uint256, CBlock*> mapOrphanBlocks;
 multimap<uint256, CBlock*> mapOrphanBlocksByPrev;
 
+bool fHeadersFirst = true;
+static const int BLOCK_DOWNLOAD_WINDOW = 1024;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+static const int64 BLOCK_DOWNLOAD_TIMEOUT = 60;
+static const int64 HEADERS_SYNC_TIMEOUT = 2 * 60;
+static const unsigned int MAX_HEADERS_RESULTS = 2000;
+static CBlockDownload blockdownload(BLOCK_DOWNLOAD_WINDOW, MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+static CNode* pnodeHeaderSync = NULL;
+static int64 nHeaderSyncTime = 0;
+void static PushGetHeaders(CNode* pnode);
+
+// The last block announced compact, framed once for every peer that takes them
+static CCriticalSection cs_compactBlock;
+static uint256 hashCompactBlock = 0;
+static CSendBuffer bufCompactBlock;
+// Compact blocks waiting on the transactions we asked their sender for
+struct CPartialBlockRequest
+{
+    CPartialBlock partial;
+    CNode* pnode; // only compared, never followed
+    int64 nTime;
+};
+static map<uint256, CPartialBlockRequest> mapPartialBlocks;
+static const unsigned int MAX_PARTIAL_BLOCKS = 16;
+static const int64 PARTIAL_BLOCK_TIMEOUT = 60;
+
 map<uint256, CDataStream*> mapOrphanTransactions;
 map<uint256, map<uint256, CDataStream*> > mapOrphanTransactionsByPrev;
 
@@ -53,9 +85,6 @@ CScript COINBASE_FLAGS;
 
 const string strMessageMagic = "Noirbits Signed Message:\n";
 
-double dHashesPerSec;
-int64 nHPSTimerStart;
-
 // Settings
 int64 nTransactionFee = 0;
 int64 nMinimumInputValue = CENT / 100;
@@ -153,6 +182,13 @@ void static ResendWalletTransactions()
         pwallet->ResendWalletTransactions();
 }
 
+// let wallets sweep their small outputs together
+void static ConsolidateWalletCoins()
+{
+    BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+        pwallet->ConsolidateCoins();
+}
+
 
 
 
@@ -634,6 +670,12 @@ bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
         nTransactionsUpdated++;
+
+        // Index it with the next template, and re-read pool transactions
+        // spending it, which now have an unconfirmed parent
+        EraseTemplateInfo(hash);
+        setTemplateDirty.insert(hash);
+        MarkSpendersTemplateDirty(hash, tx);
     }
     return true;
 }
@@ -651,11 +693,122 @@ bool CTxMemPool::remove(CTransaction &tx)
                 mapNextTx.erase(txin.prevout);
             mapTx.erase(hash);
             nTransactionsUpdated++;
+
+            // Spenders of a mined parent gain a confirmed input
+            EraseTemplateInfo(hash);
+            setTemplateDirty.erase(hash);
+            MarkSpendersTemplateDirty(hash, tx);
         }
     }
     return true;
 }
 
+void CTxMemPool::EraseTemplateInfo(const uint256& hash)
+{
+    map<uint256, CTxTemplateInfo>::iterator mi = mapTemplateInfo.find(hash);
+    if (mi == mapTemplateInfo.end())
+        return;
+    mapTemplatePriority.erase((*mi).second.itPriority);
+    mapTemplateInfo.erase(mi);
+}
+
+void CTxMemPool::MarkSpendersTemplateDirty(const uint256& hash, const CTransaction& tx)
+{
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        map<COutPoint, CInPoint>::iterator mi = mapNextTx.find(COutPoint(hash, i));
+        if (mi == mapNextTx.end())
+            continue;
+        uint256 hashSpender = (*mi).second.ptx->GetHash();
+        EraseTemplateInfo(hashSpender);
+        setTemplateDirty.insert(hashSpender);
+    }
+}
+
+void CTxMemPool::UpdateTemplateIndex(CTxDB& txdb)
+{
+    LOCK(cs);
+    int nHeight = pindexBest->nHeight;
+
+    if (pindexTemplate != pindexBest)
+    {
+        if (pindexTemplate && pindexBest->pprev == pindexTemplate)
+        {
+            // One block further: confirmed inputs keep their heights, so
+            // only the order changes.  Transactions with inputs we could
+            // not find are retried.
+            mapTemplatePriority.clear();
+            for (map<uint256, CTxTemplateInfo>::iterator mi = mapTemplateInfo.begin(); mi != mapTemplateInfo.end(); ++mi)
+                (*mi).second.itPriority = mapTemplatePriority.insert(make_pair(-(*mi).second.GetPriority(nHeight), (*mi).first));
+            for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+                if (!mapTemplateInfo.count((*mi).first))
+                    setTemplateDirty.insert((*mi).first);
+        }
+        else
+        {
+            // Reorganisation (or first use): input heights may have moved
+            mapTemplatePriority.clear();
+            mapTemplateInfo.clear();
+            for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+                setTemplateDirty.insert((*mi).first);
+        }
+        pindexTemplate = pindexBest;
+    }
+
+    BOOST_FOREACH(const uint256& hash, setTemplateDirty)
+    {
+        map<uint256, CTransaction>::iterator mi = mapTx.find(hash);
+        if (mi == mapTx.end())
+            continue;
+        const CTransaction& tx = (*mi).second;
+
+        CTxTemplateInfo info;
+        int64 nValueIn = 0;
+        bool fComplete = true;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            // Inputs from the pool add no priority until they are mined
+            map<uint256, CTransaction>::iterator mp = mapTx.find(txin.prevout.hash);
+            if (mp != mapTx.end())
+            {
+                info.setDependsOn.insert(txin.prevout.hash);
+                if (txin.prevout.n >= (*mp).second.vout.size())
+                {
+                    fComplete = false;
+                    break;
+                }
+                nValueIn += (*mp).second.vout[txin.prevout.n].nValue;
+                continue;
+            }
+
+            // Read prev transaction
+            CTransaction txPrev;
+            CTxIndex txindex;
+            if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
+            {
+                fComplete = false;
+                break;
+            }
+            int64 nValue = txPrev.vout[txin.prevout.n].nValue;
+            int nConf = txindex.GetDepthInMainChain();
+            nValueIn += nValue;
+            info.dValueIn += nValue;
+            info.dValueInHeight += (double)nValue * (nHeight - nConf);
+        }
+        if (!fComplete)
+            continue;
+
+        info.nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        info.nLegacySigOps = tx.GetLegacySigOpCount();
+        info.nFees = nValueIn - tx.GetValueOut();
+
+        CTxTemplateInfo& infoNew = mapTemplateInfo[hash];
+        infoNew = info;
+        infoNew.itPriority = mapTemplatePriority.insert(make_pair(-info.GetPriority(nHeight), hash));
+    }
+    setTemplateDirty.clear();
+}
+
 void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 {
     vtxid.clear();
@@ -964,6 +1117,106 @@ bool CTransaction::DisconnectInputs(CTxDB& txdb)
 }
 
 
+CCoinsCache::CCoinsCache()
+{
+    nSize = 0;
+    nMaxSize = 25 << 20;
+}
+
+void CCoinsCache::Put(const uint256& hash, const CCoins& coins, bool fDirty, bool fErased)
+{
+    CEntry& entry = mapCoins[hash];
+    nSize -= entry.nSize;
+    entry.coins = coins;
+    entry.fDirty = fDirty;
+    entry.fErased = fErased;
+    // Rough footprint: serialized outputs plus map node and vector overhead
+    entry.nSize = ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION) + 32 * coins.vout.size() + 128;
+    nSize += entry.nSize;
+}
+
+bool CCoinsCache::GetCoins(CTxDB& txdb, const uint256& hash, CCoins& coins)
+{
+    {
+        LOCK(cs);
+        map<uint256, CEntry>::iterator mi = mapCoins.find(hash);
+        if (mi != mapCoins.end())
+        {
+            if ((*mi).second.fErased)
+                return false;
+            coins = (*mi).second.coins;
+            return true;
+        }
+    }
+
+    if (!txdb.ReadCoins(hash, coins))
+        return false;
+
+    LOCK(cs);
+    if (!mapCoins.count(hash))
+        Put(hash, coins, false, false);
+    return true;
+}
+
+void CCoinsCache::SetCoins(const uint256& hash, const CCoins& coins)
+{
+    LOCK(cs);
+    Put(hash, coins, true, false);
+}
+
+void CCoinsCache::SpendCoins(const COutPoint& prevout)
+{
+    LOCK(cs);
+    map<uint256, CEntry>::iterator mi = mapCoins.find(prevout.hash);
+    if (mi == mapCoins.end() || (*mi).second.fErased)
+        return;
+    CCoins coins = (*mi).second.coins;
+    coins.Spend(prevout.n);
+    if (coins.IsPruned())
+        Put(prevout.hash, CCoins(), true, true);
+    else
+        Put(prevout.hash, coins, true, false);
+}
+
+void CCoinsCache::EraseCoins(const uint256& hash)
+{
+    LOCK(cs);
+    Put(hash, CCoins(), true, true);
+}
+
+bool CCoinsCache::Flush(CTxDB& txdb, bool fForce)
+{
+    LOCK(cs);
+    if (!fForce && nSize <= nMaxSize)
+        return true;
+
+    int64 nStart = GetTimeMillis();
+    unsigned int nWritten = 0;
+    bool fOk = true;
+    for (map<uint256, CEntry>::iterator mi = mapCoins.begin(); fOk && mi != mapCoins.end(); ++mi)
+    {
+        const CEntry& entry = (*mi).second;
+        if (!entry.fDirty)
+            continue;
+
+        // Commit in slices so one flush doesn't outgrow the lock table
+        if (nWritten % 1000 == 0 && (nWritten == 0 || txdb.TxnCommit()))
+            fOk = txdb.TxnBegin();
+        if (fOk)
+            fOk = entry.fErased ? txdb.EraseCoins((*mi).first) : txdb.WriteCoins((*mi).first, entry.coins);
+        nWritten++;
+    }
+    if (nWritten > 0 && (fOk ? !txdb.TxnCommit() : !txdb.TxnAbort()))
+        fOk = false;
+
+    // Unwritten changes are dropped too; the entries on disk are only
+    // ever stale in ways CCoins users tolerate
+    mapCoins.clear();
+    nSize = 0;
+    printf("CCoinsCache::Flush() : wrote %u entries in %"PRI64d"ms\n", nWritten, GetTimeMillis() - nStart);
+    return fOk ? true : error("CCoinsCache::Flush() : writing coins failed");
+}
+
 bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTestPool,
                                bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid)
 {
@@ -1014,9 +1267,30 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
         }
         else
         {
-            // Get prev tx from disk
-            if (!txPrev.ReadFromDisk(txindex.pos))
-                return error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
+            // Get prev tx outputs from the coins cache, unless one we spend
+            // has been pruned there
+            CCoins coins;
+            bool fCached = coinscache.GetCoins(txdb, prevout.hash, coins);
+            for (unsigned int j = i; fCached && j < vin.size(); j++)
+                if (vin[j].prevout.hash == prevout.hash && !coins.IsAvailable(vin[j].prevout.n))
+                    fCached = false;
+            if (fCached)
+                coins.GetTransaction(txPrev, txindex.vSpent.size());
+            else
+            {
+                // Get prev tx from disk
+                if (!txPrev.ReadFromDisk(txindex.pos))
+                    return error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString().substr(0,10).c_str(),  prevout.hash.ToString().substr(0,10).c_str());
+
+                // Cache its unspent outputs for the next spender
+                int nDepth = txindex.GetDepthInMainChain();
+                CCoins coinsNew(txPrev, nDepth > 0 ? nBestHeight - nDepth + 1 : -1);
+                for (unsigned int n = 0; n < txindex.vSpent.size(); n++)
+                    if (!txindex.vSpent[n].IsNull())
+                        coinsNew.Spend(n);
+                if (!coinsNew.IsPruned())
+                    coinscache.SetCoins(prevout.hash, coinsNew);
+            }
         }
     }
 
@@ -1083,7 +1357,8 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
 
 bool CTransaction::ConnectInputs(MapPrevTx inputs,
                                  map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash)
+                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash,
+                                 vector<CScriptCheck>* pvChecks)
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -1136,12 +1411,17 @@ bool CTransaction::ConnectInputs(MapPrevTx inputs,
             // still computed and checked, and any change will be caught at the next checkpoint.
             if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
             {
-                // Verify signature
-                if (!VerifySignature(txPrev, *this, i, fStrictPayToScriptHash, 0))
+                // Leave it to the caller's verification threads
+                if (pvChecks)
+                    pvChecks->push_back(CScriptCheck(txPrev, *this, i, fStrictPayToScriptHash, 0));
+
+                // Verify signature against the output script; txPrev may be a
+                // CCoins stand-in whose hash is not prevout.hash
+                else if (!VerifyScript(vin[i].scriptSig, txPrev.vout[prevout.n].scriptPubKey, *this, i, fStrictPayToScriptHash, 0))
                 {
                     // only during transition phase for P2SH: do not invoke anti-DoS code for
                     // potentially old clients relaying bad P2SH transactions
-                    if (fStrictPayToScriptHash && VerifySignature(txPrev, *this, i, false, 0))
+                    if (fStrictPayToScriptHash && VerifyScript(vin[i].scriptSig, txPrev.vout[prevout.n].scriptPubKey, *this, i, false, 0))
                         return error("ConnectInputs() : %s P2SH VerifySignature failed", GetHash().ToString().substr(0,10).c_str());
 
                     return DoS(100,error("ConnectInputs() : %s VerifySignature failed", GetHash().ToString().substr(0,10).c_str()));
@@ -1174,6 +1454,39 @@ bool CTransaction::ConnectInputs(MapPrevTx inputs,
 }
 
 
+bool CScriptCheck::operator()() const
+{
+    const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
+    if (!VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, fStrictPayToScriptHash, nHashType))
+        return error("CScriptCheck() : %s VerifySignature failed", ptxTo->GetHash().ToString().substr(0,10).c_str());
+    return true;
+}
+
+void ThreadScriptCheck(void* parg)
+{
+    // Make this thread recognisable as a script verification thread
+    RenameThread("bitcoin-scriptch");
+
+    try
+    {
+        vnThreadsRunning[THREAD_SCRIPTCHECK]++;
+        scriptcheckqueue.Thread();
+        vnThreadsRunning[THREAD_SCRIPTCHECK]--;
+    }
+    catch (std::exception& e) {
+        vnThreadsRunning[THREAD_SCRIPTCHECK]--;
+        PrintException(&e, "ThreadScriptCheck()");
+    } catch (...) {
+        vnThreadsRunning[THREAD_SCRIPTCHECK]--;
+        PrintException(NULL, "ThreadScriptCheck()");
+    }
+}
+
+void StopScriptCheckThreads()
+{
+    scriptcheckqueue.Quit();
+}
+
 bool CTransaction::ClientConnectInputs()
 {
     if (IsCoinBase())
@@ -1230,6 +1543,17 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
         if (!vtx[i].DisconnectInputs(txdb))
             return false;
 
+    // Outputs this block spent are unspent again; let them be read back
+    // from disk rather than reconstructing them here
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+    {
+        coinscache.EraseCoins(tx.GetHash());
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            coinscache.EraseCoins(txin.prevout.hash);
+    }
+
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
     if (pindex->pprev)
@@ -1268,6 +1592,10 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
     //// issue here: it doesn't know the version
     unsigned int nTxPos = pindex->nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - 1 + GetSizeOfCompactSize(vtx.size());
 
+    // Script checks are handed to the verification threads as each
+    // transaction is connected, and all must pass before anything is written
+    CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads > 1 ? &scriptcheckqueue : NULL);
+
     map<uint256, CTxIndex> mapQueuedChanges;
     int64 nFees = 0;
     unsigned int nSigOps = 0;
@@ -1310,13 +1638,22 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 
             nFees += tx.GetValueIn(mapInputs)-tx.GetValueOut();
 
-            if (!tx.ConnectInputs(mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fStrictPayToScriptHash))
+            vector<CScriptCheck> vChecks;
+            if (!tx.ConnectInputs(mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fStrictPayToScriptHash, nScriptCheckThreads > 1 ? &vChecks : NULL))
                 return false;
+            control.Add(vChecks);
+
+            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                coinscache.SpendCoins(txin.prevout);
         }
 
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
+        coinscache.SetCoins(hashTx, CCoins(tx, pindex->nHeight));
     }
 
+    if (!control.Wait())
+        return DoS(100, error("ConnectBlock() : script verification failed"));
+
     // Write queued txindex changes
     for (map<uint256, CTxIndex>::iterator mi = mapQueuedChanges.begin(); mi != mapQueuedChanges.end(); ++mi)
     {
@@ -1531,6 +1868,14 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
         }
     }
 
+    // Write the coins cache back once it outgrows -dbcache
+    coinscache.Flush(txdb, false);
+
+    // Commit blkindex.dat once enough blocks have built up in the batch.
+    // On failure the writes stay queued and are retried with the next block.
+    txdbbatch.BlockConnected();
+    FlushBlockIndexBatch(txdb, false);
+
     // Update best block in wallet (so we can detect restored wallets)
     bool fIsInitialDownload = IsInitialBlockDownload();
     if (!fIsInitialDownload)
@@ -1729,6 +2074,16 @@ bool CBlock::AcceptBlock()
     int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
     if (hashBestChain == hash)
     {
+        // Peers that take compact blocks get this instead of the inv
+        if ((nLocalServices & NODE_COMPACT_BLOCKS) && !IsInitialBlockDownload())
+        {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << CCompactBlock(*this);
+            LOCK(cs_compactBlock);
+            hashCompactBlock = hash;
+            bufCompactBlock = MakeSendBuffer("cmpctblock", ss);
+        }
+
         LOCK(cs_vNodes);
         BOOST_FOREACH(CNode* pnode, vNodes)
             if (nBestHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
@@ -1784,8 +2139,14 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
         mapOrphanBlocks.insert(make_pair(hash, pblock2));
         mapOrphanBlocksByPrev.insert(make_pair(pblock2->hashPrevBlock, pblock2));
 
-        // Ask this guy to fill in what we're missing
-        if (pfrom)
+        // Ask this guy to fill in what we're missing, unless the headers
+        // already told us and the block is on its way
+        if (pfrom && fHeadersFirst)
+        {
+            if (!blockdownload.Contains(hash))
+                PushGetHeaders(pfrom);
+        }
+        else if (pfrom)
             pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(pblock2));
         return true;
     }
@@ -1883,6 +2244,95 @@ FILE* AppendBlockFile(unsigned int& nFileRet)
     }
 }
 
+bool FlushBlockIndexBatch(CTxDB& txdb, bool fForce)
+{
+    if (!txdbbatch.IsEnabled() || !txdbbatch.IsFlushDue(fForce, IsInitialBlockDownload()))
+        return true;
+
+    // Everything appended to the block files so far is indexed by this
+    // batch, so after a crash only what lies past here needs replaying.
+    // Make sure the blocks reach the disk before the index that points at them.
+    unsigned int nFile;
+    FILE* file = AppendBlockFile(nFile);
+    if (!file)
+        return error("FlushBlockIndexBatch() : AppendBlockFile failed");
+    long nBlockPos = ftell(file);
+    FileCommit(file);
+    fclose(file);
+    if (nBlockPos < 0 || !txdb.WriteBlockFileReplayPos(nFile, nBlockPos))
+        return error("FlushBlockIndexBatch() : WriteBlockFileReplayPos failed");
+    return txdb.FlushBatch();
+}
+
+// Re-index blocks appended after the last batch commit, which a crash
+// would otherwise leave unreferenced in the block files
+bool static ReplayBlockFiles()
+{
+    unsigned int nFile, nBlockPos;
+    {
+        CTxDB txdb("r");
+        if (!txdb.ReadBlockFileReplayPos(nFile, nBlockPos))
+            return true;
+    }
+
+    int64 nStart = GetTimeMillis();
+    int nReplayed = 0;
+    for (; !fRequestShutdown; nFile++, nBlockPos = 0)
+    {
+        CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
+        if (!filein)
+            break;
+        try {
+            loop
+            {
+                unsigned char pchMagic[sizeof(pchMessageStart)];
+                unsigned int nSize;
+                filein >> FLATDATA(pchMagic) >> nSize;
+                if (memcmp(pchMagic, pchMessageStart, sizeof(pchMessageStart)) != 0 || nSize > MAX_BLOCK_SIZE)
+                    break;
+                long nPos = ftell(filein);
+                CBlock block;
+                filein >> block;
+
+                // Blocks were written in the order they were accepted, so
+                // each one's parent has been seen by the time we reach it
+                if (mapBlockIndex.count(block.GetHash()) || !mapBlockIndex.count(block.hashPrevBlock))
+                    continue;
+                if (!block.CheckBlock())
+                    break;
+                if (!block.AddToBlockIndex(nFile, nPos))
+                    return error("ReplayBlockFiles() : AddToBlockIndex failed");
+                nReplayed++;
+            }
+        }
+        catch (std::exception &e) {
+            // Torn write at the end of the last file
+        }
+    }
+
+    // The blkindex.map copy may already know blocks the batch never committed;
+    // connect the chain with the most work if it isn't the best one yet
+    CBlockIndex* pindexMostWork = pindexBest;
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        if (pindexMostWork && item.second->bnChainWork > pindexMostWork->bnChainWork)
+            pindexMostWork = item.second;
+    if (pindexMostWork != pindexBest)
+    {
+        CBlock block;
+        CTxDB txdb;
+        if (!block.ReadFromDisk(pindexMostWork) || !block.SetBestChain(txdb, pindexMostWork))
+            printf("ReplayBlockFiles() : could not connect block %s\n", pindexMostWork->GetBlockHash().ToString().substr(0,20).c_str());
+    }
+
+    if (nReplayed > 0 || pindexMostWork != pindexBest)
+        printf("ReplayBlockFiles() : re-indexed %d blocks, best height %d  %"PRI64d"ms\n", nReplayed, nBestHeight, GetTimeMillis() - nStart);
+
+    // Writing through again, nothing will be left to replay
+    if (!txdbbatch.IsEnabled())
+        CTxDB().EraseBlockFileReplayPos();
+    return true;
+}
+
 bool LoadBlockIndex(bool fAllowNew)
 {
     if (fTestNet)
@@ -1983,7 +2433,11 @@ bool LoadBlockIndex(bool fAllowNew)
             return error("LoadBlockIndex() : genesis block not accepted");
     }
 
-    return true;
+    if (!ReplayBlockFiles())
+        return false;
+
+    CTxDB txdbFlush;
+    return FlushBlockIndexBatch(txdbFlush, true);
 }
 
 
@@ -2280,70 +2734,598 @@ bool CAlert::ProcessAlert()
 //
 
 
-bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
+CBlockDownload::CBlockDownload(int nWindowIn, int nMaxPerPeerIn)
 {
-    switch (inv.type)
-    {
-    case MSG_TX:
-        {
-        bool txInMap = false;
-            {
-            LOCK(mempool.cs);
-            txInMap = (mempool.exists(inv.hash));
-            }
-        return txInMap ||
-               mapOrphanTransactions.count(inv.hash) ||
-               txdb.ContainsTx(inv.hash);
-        }
-
-    case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash) ||
-               mapOrphanBlocks.count(inv.hash);
-    }
-    // Don't know what it is, just say we already got one
-    return true;
+    nWindow = nWindowIn;
+    nMaxPerPeer = nMaxPerPeerIn;
+    Clear();
 }
 
+void CBlockDownload::Clear()
+{
+    hashBase = 0;
+    nBaseHeight = 0;
+    vHash.clear();
+    setHash.clear();
+    bnWork = 0;
+    setReceived.clear();
+    nFirstMissing = 0;
+}
 
+void CBlockDownload::SetChain(const uint256& hashBaseIn, int nBaseHeightIn, const vector<uint256>& vHashIn, const CBigNum& bnWorkIn)
+{
+    // Requests already out are kept; they are for blocks by hash either way
+    Clear();
+    hashBase = hashBaseIn;
+    nBaseHeight = nBaseHeightIn;
+    Extend(vHashIn, bnWorkIn);
+}
 
+void CBlockDownload::Extend(const vector<uint256>& vHashIn, const CBigNum& bnWorkIn)
+{
+    vHash.insert(vHash.end(), vHashIn.begin(), vHashIn.end());
+    setHash.insert(vHashIn.begin(), vHashIn.end());
+    bnWork = bnWorkIn;
+}
 
-// The message start string is designed to be unlikely to occur in normal data.
-// The characters are rarely used upper ascii, not valid as UTF-8, and produce
-// a large 4-byte int at any alignment.
-unsigned char pchMessageStart[4] = { 0xfc, 0xd9, 0xb7, 0xdd };
+void CBlockDownload::SetConnected(int nHeight, const uint256& hash)
+{
+    if (vHash.empty() || nHeight <= nBaseHeight)
+        return;
+    if (nHeight >= GetTipHeight())
+    {
+        // Our chain caught up with the headers, or went past them
+        if (nHeight > GetTipHeight() || hash == vHash.back())
+            Clear();
+        return;
+    }
 
+    unsigned int n = nHeight - nBaseHeight;
+    if (vHash[n - 1] != hash)
+        return;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        setHash.erase(vHash.front());
+        setReceived.erase(vHash.front());
+        vHash.pop_front();
+    }
+    hashBase = hash;
+    nBaseHeight = nHeight;
+    nFirstMissing = (nFirstMissing > n ? nFirstMissing - n : 0);
+}
 
-bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
+vector<uint256> CBlockDownload::GetLocatorHashes() const
 {
-    static map<CService, CPubKey> mapReuseKey;
-    RandAddSeedPerfmon();
-    if (fDebug)
-        printf("received: %s (%d bytes)\n", strCommand.c_str(), vRecv.size());
-    if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0)
+    vector<uint256> vLocator;
+    int nStep = 1;
+    for (int i = (int)vHash.size() - 1; i >= 0; i -= nStep)
     {
-        printf("dropmessagestest DROPPING RECV MESSAGE\n");
-        return true;
+        vLocator.push_back(vHash[i]);
+        if (vLocator.size() > 10)
+            nStep *= 2;
     }
+    return vLocator;
+}
 
+int CBlockDownload::GetInFlight(CNode* pnode) const
+{
+    map<CNode*, int>::const_iterator mi = mapPeerInFlight.find(pnode);
+    return (mi == mapPeerInFlight.end() ? 0 : (*mi).second);
+}
+
+void CBlockDownload::GetRequests(CNode* pnode, int nMaxHeight, int64 nNow, vector<CInv>& vGetData)
+{
+    while (nFirstMissing < vHash.size() && setReceived.count(vHash[nFirstMissing]))
+        nFirstMissing++;
 
+    int nInFlight = GetInFlight(pnode);
+    unsigned int nEnd = min((unsigned int)vHash.size(), nFirstMissing + nWindow);
+    nEnd = min(nEnd, (unsigned int)max(nMaxHeight - nBaseHeight, 0));
+    for (unsigned int i = nFirstMissing; i < nEnd && nInFlight < nMaxPerPeer; i++)
+    {
+        const uint256& hash = vHash[i];
+        if (setReceived.count(hash) || mapInFlight.count(hash))
+            continue;
+        mapInFlight.insert(make_pair(hash, make_pair(pnode, nNow)));
+        if (mapPeerInFlight[pnode]++ == 0)
+            pnode->AddRef();
+        nInFlight++;
+        vGetData.push_back(CInv(MSG_BLOCK, hash));
+    }
+}
 
+void CBlockDownload::ReleaseRequest(InFlightMap::iterator it)
+{
+    CNode* pnode = (*it).second.first;
+    map<CNode*, int>::iterator mi = mapPeerInFlight.find(pnode);
+    if (--(*mi).second == 0)
+    {
+        mapPeerInFlight.erase(mi);
+        pnode->Release();
+    }
+    mapInFlight.erase(it);
+}
 
+void CBlockDownload::BlockReceived(const uint256& hash, bool fValid)
+{
+    InFlightMap::iterator it = mapInFlight.find(hash);
+    if (it != mapInFlight.end())
+        ReleaseRequest(it);
+    if (fValid && Contains(hash))
+        setReceived.insert(hash);
+}
 
-    if (strCommand == "version")
+void CBlockDownload::ExpireRequests(int64 nNow, int64 nTimeout, set<CNode*>& setStalled)
+{
+    InFlightMap::iterator it = mapInFlight.begin();
+    while (it != mapInFlight.end())
     {
-        // Each connection can only send one version message
-        if (pfrom->nVersion != 0)
+        CNode* pnode = (*it).second.first;
+        if (pnode->fDisconnect || nNow - (*it).second.second > nTimeout)
         {
-            pfrom->Misbehaving(1);
-            return false;
+            setStalled.insert(pnode);
+            ReleaseRequest(it++);
         }
+        else
+            it++;
+    }
+}
 
-        int64 nTime;
-        CAddress addrMe;
-        CAddress addrFrom;
-        uint64 nNonce = 1;
-        vRecv >> pfrom->nVersion >> pfrom->nServices >> nTime >> addrMe;
-        if (pfrom->nVersion < MIN_PROTO_VERSION && nBestHeight >= MIN_PROTO_VERSION_HEIGHT)
+
+CCompactBlock::CCompactBlock(const CBlock& block)
+{
+    header.nVersion = block.nVersion;
+    header.hashPrevBlock = block.hashPrevBlock;
+    header.hashMerkleRoot = block.hashMerkleRoot;
+    header.nTime = block.nTime;
+    header.nBits = block.nBits;
+    header.nNonce = block.nNonce;
+    nNonce = GetRandHash().Get64();
+
+    // Nobody has the coinbase yet
+    uint256 salt = GetSalt();
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        if (i == 0)
+        {
+            CPrefilledTx prefilled;
+            prefilled.nIndex = 0;
+            prefilled.tx = block.vtx[0];
+            vPrefilled.push_back(prefilled);
+        }
+        else
+            vShortId.push_back(CShortTxId(GetShortTxId(salt, block.vtx[i].GetHash())));
+    }
+}
+
+uint256 CCompactBlock::GetSalt() const
+{
+    uint256 hashBlock = header.GetHash();
+    return Hash(BEGIN(hashBlock), END(hashBlock), BEGIN(nNonce), END(nNonce));
+}
+
+uint64 CCompactBlock::GetShortTxId(const uint256& salt, const uint256& hashTx)
+{
+    return Hash(BEGIN(salt), END(salt), BEGIN(hashTx), END(hashTx)).Get64() & 0xffffffffffffULL;
+}
+
+bool CPartialBlock::Init(const CCompactBlock& cmpctblock, const map<uint256, CTransaction>& mapPool)
+{
+    // The smallest transaction is over 60 bytes
+    unsigned int nTx = cmpctblock.vShortId.size() + cmpctblock.vPrefilled.size();
+    if (nTx == 0 || nTx > MAX_BLOCK_SIZE / 60)
+        return false;
+
+    block = cmpctblock.header;
+    block.vtx.assign(nTx, CTransaction());
+    vHave.assign(nTx, false);
+    BOOST_FOREACH(const CPrefilledTx& prefilled, cmpctblock.vPrefilled)
+    {
+        if (prefilled.nIndex >= nTx || vHave[prefilled.nIndex])
+            return false;
+        block.vtx[prefilled.nIndex] = prefilled.tx;
+        vHave[prefilled.nIndex] = true;
+    }
+
+    // The short ids fill the places left, in order.  A short id that is
+    // there twice can't tell us which is which, so both are asked for.
+    map<uint64, unsigned int> mapShortId;
+    set<uint64> setCollided;
+    unsigned int j = 0;
+    for (unsigned int i = 0; i < nTx; i++)
+        if (!vHave[i])
+            if (!mapShortId.insert(make_pair(cmpctblock.vShortId[j++].n, i)).second)
+                setCollided.insert(cmpctblock.vShortId[j - 1].n);
+    BOOST_FOREACH(uint64 n, setCollided)
+        mapShortId.erase(n);
+
+    // Likewise for two pool transactions with the same short id
+    uint256 salt = cmpctblock.GetSalt();
+    set<unsigned int> setAmbiguous;
+    for (map<uint256, CTransaction>::const_iterator mi = mapPool.begin(); mi != mapPool.end(); ++mi)
+    {
+        map<uint64, unsigned int>::iterator it = mapShortId.find(CCompactBlock::GetShortTxId(salt, (*mi).first));
+        if (it == mapShortId.end())
+            continue;
+        unsigned int nIndex = (*it).second;
+        if (vHave[nIndex])
+        {
+            vHave[nIndex] = false;
+            setAmbiguous.insert(nIndex);
+            continue;
+        }
+        if (setAmbiguous.count(nIndex))
+            continue;
+        block.vtx[nIndex] = (*mi).second;
+        vHave[nIndex] = true;
+    }
+    return true;
+}
+
+void CPartialBlock::GetMissing(vector<unsigned int>& vIndex) const
+{
+    for (unsigned int i = 0; i < vHave.size(); i++)
+        if (!vHave[i])
+            vIndex.push_back(i);
+}
+
+bool CPartialBlock::FillMissing(const vector<CTransaction>& vtx)
+{
+    vector<unsigned int> vIndex;
+    GetMissing(vIndex);
+    if (vtx.size() != vIndex.size())
+        return false;
+    for (unsigned int i = 0; i < vIndex.size(); i++)
+    {
+        block.vtx[vIndex[i]] = vtx[i];
+        vHave[vIndex[i]] = true;
+    }
+    return true;
+}
+
+bool CPartialBlock::GetBlock(CBlock& blockRet) const
+{
+    BOOST_FOREACH(bool fHave, vHave)
+        if (!fHave)
+            return false;
+
+    // A short id collision we didn't see would give the wrong transaction
+    blockRet = block;
+    blockRet.vMerkleTree.clear();
+    return (blockRet.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+void static SetHeaderSyncNode(CNode* pnode)
+{
+    if (pnodeHeaderSync)
+        pnodeHeaderSync->Release();
+    pnodeHeaderSync = (pnode ? pnode->AddRef() : NULL);
+    nHeaderSyncTime = GetTime();
+}
+
+// Ask for headers following the best header chain we know of
+void static PushGetHeaders(CNode* pnode)
+{
+    CBlockIndex* pindexBase = pindexBest;
+    if (!blockdownload.IsEmpty())
+    {
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(blockdownload.GetBaseHash());
+        if (mi != mapBlockIndex.end())
+            pindexBase = (*mi).second;
+    }
+    pnode->PushMessage("getheaders", CBlockLocator(blockdownload.GetLocatorHashes(), pindexBase), uint256(0));
+}
+
+bool static ProcessBlockHeaders(CNode* pfrom, const vector<CBlock>& vHeaders)
+{
+    if (pfrom == pnodeHeaderSync)
+        nHeaderSyncTime = GetTime();
+    if (vHeaders.empty())
+    {
+        if (pfrom == pnodeHeaderSync)
+            SetHeaderSyncNode(NULL);
+        return true;
+    }
+
+    // Either the headers extend our header chain, or they build on a block
+    // we have and may replace it
+    bool fExtend = (!blockdownload.IsEmpty() && vHeaders[0].hashPrevBlock == blockdownload.GetTipHash());
+    unsigned int nStart = 0;
+    uint256 hashBase = 0;
+    int nHeight;
+    CBigNum bnWork;
+    if (fExtend)
+    {
+        nHeight = blockdownload.GetTipHeight();
+        bnWork = blockdownload.GetWork();
+    }
+    else
+    {
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(vHeaders[0].hashPrevBlock);
+        if (mi == mapBlockIndex.end())
+        {
+            printf("ProcessBlockHeaders() : headers from %s don't connect, asking again\n", pfrom->addr.ToString().c_str());
+            if (pfrom == pnodeHeaderSync)
+                PushGetHeaders(pfrom);
+            return true;
+        }
+        CBlockIndex* pindexPrev = (*mi).second;
+
+        // Skip over blocks we already have
+        while (nStart < vHeaders.size() && vHeaders[nStart].hashPrevBlock == pindexPrev->GetBlockHash() &&
+               (mi = mapBlockIndex.find(vHeaders[nStart].GetHash())) != mapBlockIndex.end())
+        {
+            pindexPrev = (*mi).second;
+            nStart++;
+        }
+        if (nStart == vHeaders.size())
+        {
+            if (vHeaders.size() == MAX_HEADERS_RESULTS)
+                pfrom->PushMessage("getheaders", CBlockLocator(pindexPrev), uint256(0));
+            return true;
+        }
+        hashBase = pindexPrev->GetBlockHash();
+        nHeight = pindexPrev->nHeight;
+        bnWork = pindexPrev->bnChainWork;
+    }
+    int nBaseHeight = nHeight;
+
+    // Same context-free checks as a block gets, and the checkpoints
+    CBlockIndex* pcheckpoint = Checkpoints::GetLastCheckpoint(mapBlockIndex);
+    uint256 hashPrev = (fExtend ? blockdownload.GetTipHash() : hashBase);
+    vector<uint256> vHash;
+    vHash.reserve(vHeaders.size() - nStart);
+    for (unsigned int i = nStart; i < vHeaders.size(); i++)
+    {
+        const CBlock& header = vHeaders[i];
+        uint256 hash = header.GetHash();
+        nHeight++;
+        if (header.hashPrevBlock != hashPrev)
+        {
+            pfrom->Misbehaving(20);
+            return error("ProcessBlockHeaders() : headers not in sequence at %d", nHeight);
+        }
+        if (!CheckProofOfWork(header.GetPoWHash(), header.nBits))
+        {
+            pfrom->Misbehaving(100);
+            return error("ProcessBlockHeaders() : proof of work failed at %d", nHeight);
+        }
+        if (header.GetBlockTime() > GetAdjustedTime() + 2 * 60 * 60)
+            return error("ProcessBlockHeaders() : header timestamp too far in the future");
+        if (!Checkpoints::CheckBlock(nHeight, hash))
+        {
+            pfrom->Misbehaving(100);
+            return error("ProcessBlockHeaders() : rejected by checkpoint lockin at %d", nHeight);
+        }
+        if (pcheckpoint && nHeight > pcheckpoint->nHeight)
+        {
+            // Keep anyone from making us fetch a cheap chain off the last checkpoint
+            int64 deltaTime = header.GetBlockTime() - pcheckpoint->nTime;
+            CBigNum bnNewBlock;
+            bnNewBlock.SetCompact(header.nBits);
+            CBigNum bnRequired;
+            bnRequired.SetCompact(ComputeMinWork(pcheckpoint->nBits, deltaTime));
+            if (deltaTime < 0 || bnNewBlock > bnRequired)
+            {
+                pfrom->Misbehaving(100);
+                return error("ProcessBlockHeaders() : header with too little proof-of-work at %d", nHeight);
+            }
+        }
+
+        CBigNum bnTarget;
+        bnTarget.SetCompact(header.nBits);
+        bnWork += (CBigNum(1)<<256) / (bnTarget+1);
+        vHash.push_back(hash);
+        hashPrev = hash;
+    }
+
+    if (fExtend)
+        blockdownload.Extend(vHash, bnWork);
+    else if (pfrom == pnodeHeaderSync || blockdownload.IsEmpty() || bnWork > blockdownload.GetWork())
+        blockdownload.SetChain(hashBase, nBaseHeight, vHash, bnWork);
+    else
+        return true;
+    printf("ProcessBlockHeaders() : %u headers from %s, header chain now at %d\n", (unsigned int)vHash.size(), pfrom->addr.ToString().c_str(), blockdownload.GetTipHeight());
+
+    // A full batch means there are more to come
+    if (vHeaders.size() == MAX_HEADERS_RESULTS)
+        PushGetHeaders(pfrom);
+    else if (pfrom == pnodeHeaderSync)
+        SetHeaderSyncNode(NULL);
+    return true;
+}
+
+// Headers come from one peer at a time; the blocks from every peer that has them
+void static SendHeadersFirstRequests(CNode* pto)
+{
+    int64 nNow = GetTime();
+    if (pnodeHeaderSync && (pnodeHeaderSync->fDisconnect || nNow - nHeaderSyncTime > HEADERS_SYNC_TIMEOUT))
+    {
+        printf("header sync with %s stalled\n", pnodeHeaderSync->addr.ToString().c_str());
+        SetHeaderSyncNode(NULL);
+    }
+
+    int nKnownHeight = max(nBestHeight, blockdownload.IsEmpty() ? 0 : blockdownload.GetTipHeight());
+    if (!pnodeHeaderSync && !pto->fClient && !pto->fOneShot && !pto->fDisconnect &&
+        (pto->nVersion < NOBLKS_VERSION_START || pto->nVersion >= NOBLKS_VERSION_END) &&
+        pto->nStartingHeight > nKnownHeight)
+    {
+        SetHeaderSyncNode(pto);
+        PushGetHeaders(pto);
+    }
+
+    blockdownload.SetConnected(nBestHeight, hashBestChain);
+    set<CNode*> setStalled;
+    blockdownload.ExpireRequests(nNow, BLOCK_DOWNLOAD_TIMEOUT, setStalled);
+    BOOST_FOREACH(CNode* pnode, setStalled)
+    {
+        // Let someone faster have its place, as long as there is someone
+        if (!pnode->fDisconnect && vNodes.size() > 1)
+        {
+            printf("block download from %s timed out, disconnecting\n", pnode->addr.ToString().c_str());
+            pnode->fDisconnect = true;
+        }
+    }
+
+    if (blockdownload.IsEmpty() || blockdownload.GetWork() <= bnBestChainWork || pto->fClient || pto->fDisconnect)
+        return;
+    vector<CInv> vGetData;
+    blockdownload.GetRequests(pto, pto->nStartingHeight, nNow, vGetData);
+    if (!vGetData.empty())
+    {
+        if (fDebugNet)
+            printf("requesting %u blocks from %s, %d in flight\n", (unsigned int)vGetData.size(), pto->addr.ToString().c_str(), blockdownload.GetInFlight());
+        pto->PushMessage("getdata", vGetData);
+    }
+}
+
+
+bool static ProcessReceivedBlock(CNode* pfrom, CBlock& block)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    bool fAccepted = ProcessBlock(pfrom, &block);
+    if (fAccepted)
+        mapAlreadyAskedFor.erase(inv);
+    if (fHeadersFirst)
+        blockdownload.BlockReceived(inv.hash, fAccepted || mapBlockIndex.count(inv.hash) || mapOrphanBlocks.count(inv.hash));
+    if (block.nDoS) pfrom->Misbehaving(block.nDoS);
+    return fAccepted;
+}
+
+// A block put together from a compact block, or fetched whole if a short
+// id collision gave us the wrong transaction
+bool static ProcessPartialBlock(CNode* pfrom, const CPartialBlock& partial)
+{
+    CBlock block;
+    if (!partial.GetBlock(block))
+    {
+        printf("compact block %s doesn't match its merkle root, fetching it whole\n", partial.GetHash().ToString().substr(0,20).c_str());
+        pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, partial.GetHash())));
+        return false;
+    }
+    return ProcessReceivedBlock(pfrom, block);
+}
+
+bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
+{
+    switch (inv.type)
+    {
+    case MSG_TX:
+        {
+        bool txInMap = false;
+            {
+            LOCK(mempool.cs);
+            txInMap = (mempool.exists(inv.hash));
+            }
+        return txInMap ||
+               mapOrphanTransactions.count(inv.hash) ||
+               txdb.ContainsTx(inv.hash);
+        }
+
+    case MSG_BLOCK:
+        return mapBlockIndex.count(inv.hash) ||
+               mapOrphanBlocks.count(inv.hash);
+    }
+    // Don't know what it is, just say we already got one
+    return true;
+}
+
+
+
+
+// The message start string is designed to be unlikely to occur in normal data.
+// The characters are rarely used upper ascii, not valid as UTF-8, and produce
+// a large 4-byte int at any alignment.
+unsigned char pchMessageStart[4] = { 0xfc, 0xd9, 0xb7, 0xdd };
+
+
+// Frame a "block" message straight from the bytes in the block file. The
+// disk and network serializations of a block are the same, so there is no
+// need to decode and encode it again.
+bool static ReadBlockMessage(const CBlockIndex* pindex, CSendBuffer& bufRet)
+{
+    if (pindex->nBlockPos < sizeof(pchMessageStart) + sizeof(unsigned int))
+        return error("ReadBlockMessage() : bad block position");
+    CAutoFile filein = CAutoFile(OpenBlockFile(pindex->nFile, pindex->nBlockPos - sizeof(pchMessageStart) - sizeof(unsigned int), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("ReadBlockMessage() : OpenBlockFile failed");
+
+    boost::shared_ptr<CSerializeData> pbuf(new CSerializeData());
+    try {
+        unsigned char pchMagic[sizeof(pchMessageStart)];
+        unsigned int nSize;
+        filein >> FLATDATA(pchMagic) >> nSize;
+        if (memcmp(pchMagic, pchMessageStart, sizeof(pchMessageStart)) != 0 || nSize < 80 || nSize > MAX_BLOCK_SIZE)
+            return error("ReadBlockMessage() : bad index header for %s", pindex->GetBlockHash().ToString().substr(0,20).c_str());
+
+        pbuf->resize(CMessageHeader::HEADER_SIZE + nSize);
+        filein.read(&(*pbuf)[CMessageHeader::HEADER_SIZE], nSize);
+    }
+    catch (std::exception &e) {
+        return error("%s() : I/O error", __PRETTY_FUNCTION__);
+    }
+
+    // The header leads the block, so this catches a stale index cheaply
+    const char* pchPayload = &(*pbuf)[CMessageHeader::HEADER_SIZE];
+    unsigned int nPayloadSize = pbuf->size() - CMessageHeader::HEADER_SIZE;
+    if (Hash(pchPayload, pchPayload + 80) != pindex->GetBlockHash())
+        return error("ReadBlockMessage() : block %s not found at its index position", pindex->GetBlockHash().ToString().substr(0,20).c_str());
+
+    CMessageHeader hdr("block", nPayloadSize);
+    uint256 hash = Hash(pchPayload, pchPayload + nPayloadSize);
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    assert(ss.size() == CMessageHeader::HEADER_SIZE);
+    memcpy(&(*pbuf)[0], &ss[0], ss.size());
+
+    bufRet = pbuf;
+    return true;
+}
+
+
+// Messages that only touch the peer itself, the address manager or relay
+// memory, taking cs_main for no more than a lookup, so they needn't wait
+// behind block and transaction validation
+bool static IsMainLockFree(const string& strCommand)
+{
+    return (strCommand == "version" || strCommand == "verack" || strCommand == "ping" ||
+            strCommand == "addr" || strCommand == "getaddr" || strCommand == "getdata");
+}
+
+bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
+{
+    static map<CService, CPubKey> mapReuseKey;
+    RandAddSeedPerfmon();
+    if (fDebug)
+        printf("received: %s (%d bytes)\n", strCommand.c_str(), vRecv.size());
+    if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0)
+    {
+        printf("dropmessagestest DROPPING RECV MESSAGE\n");
+        return true;
+    }
+
+
+
+
+
+    if (strCommand == "version")
+    {
+        // Each connection can only send one version message
+        if (pfrom->nVersion != 0)
+        {
+            pfrom->Misbehaving(1);
+            return false;
+        }
+
+        int64 nTime;
+        CAddress addrMe;
+        CAddress addrFrom;
+        uint64 nNonce = 1;
+        vRecv >> pfrom->nVersion >> pfrom->nServices >> nTime >> addrMe;
+        if (pfrom->nVersion < MIN_PROTO_VERSION && nBestHeight >= MIN_PROTO_VERSION_HEIGHT)
         {
             // Since February 20, 2012, the protocol is initiated at version 209,
             // and earlier versions are no longer supported
@@ -2380,17 +3362,27 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             pfrom->PushVersion();
 
         pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
+        pfrom->fCompactBlocks = ((nLocalServices & NODE_COMPACT_BLOCKS) && (pfrom->nServices & NODE_COMPACT_BLOCKS) &&
+                                 pfrom->nVersion >= COMPACT_BLOCKS_VERSION);
 
         AddTimeData(pfrom->addr, nTime);
 
         // Change version
         pfrom->PushMessage("verack");
-        pfrom->vSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+        {
+            LOCK(pfrom->cs_vSend);
+            pfrom->vSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+        }
 
         if (!pfrom->fInbound)
         {
             // Advertise our address
-            if (!fNoListen && !IsInitialBlockDownload())
+            bool fInitialDownload;
+            {
+                LOCK(cs_main);
+                fInitialDownload = IsInitialBlockDownload();
+            }
+            if (!fNoListen && !fInitialDownload)
             {
                 CAddress addr = GetLocalAddress(&pfrom->addr);
                 if (addr.IsRoutable())
@@ -2414,11 +3406,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
         // Ask the first connected node for block updates
         static int nAskedForBlocks = 0;
-        if (!pfrom->fClient && !pfrom->fOneShot &&
+        if (!fHeadersFirst && !pfrom->fClient && !pfrom->fOneShot &&
             (pfrom->nVersion < NOBLKS_VERSION_START ||
              pfrom->nVersion >= NOBLKS_VERSION_END) &&
              (nAskedForBlocks < 1 || vNodes.size() <= 1))
         {
+            LOCK(cs_main);
             nAskedForBlocks++;
             pfrom->PushGetBlocks(pindexBest, uint256(0));
         }
@@ -2434,7 +3427,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
         printf("receive version message: version %d, blocks=%d, us=%s, them=%s, peer=%s\n", pfrom->nVersion, pfrom->nStartingHeight, addrMe.ToString().c_str(), addrFrom.ToString().c_str(), pfrom->addr.ToString().c_str());
 
-        cPeerBlockCounts.input(pfrom->nStartingHeight);
+        {
+            LOCK(cs_main);
+            cPeerBlockCounts.input(pfrom->nStartingHeight);
+        }
     }
 
 
@@ -2448,7 +3444,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
     else if (strCommand == "verack")
     {
-        pfrom->vRecv.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+        pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
     }
 
 
@@ -2550,11 +3546,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             if (fDebug)
                 printf("  got inventory: %s  %s\n", inv.ToString().c_str(), fAlreadyHave ? "have" : "new");
 
-            if (!fAlreadyHave)
-                pfrom->AskFor(inv);
-            else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
-                pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(mapOrphanBlocks[inv.hash]));
-            } else if (nInv == nLastBlock) {
+            if (!fAlreadyHave) {
+                // Blocks of the header chain are fetched through the download window
+                if (!(fHeadersFirst && inv.type == MSG_BLOCK && blockdownload.Contains(inv.hash)))
+                    pfrom->AskFor(inv);
+            } else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
+                if (fHeadersFirst)
+                    PushGetHeaders(pfrom);
+                else
+                    pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(mapOrphanBlocks[inv.hash]));
+            } else if (nInv == nLastBlock && !fHeadersFirst) {
                 // In case we are on a very long side-chain, it is possible that we already have
                 // the last block in an inv bundle sent in response to getblocks. Try to detect
                 // this situation and push another getblocks to continue.
@@ -2592,17 +3593,34 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
             if (inv.type == MSG_BLOCK)
             {
-                // Send block from disk
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                // Send block from disk. Index entries are never freed, so
+                // only the lookup needs cs_main, and not even that for a
+                // block still in the cache.
+                CSendBuffer buf;
+                bool fFound = GetBlockCache().Get(inv.hash, buf);
+                if (!fFound)
                 {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
+                    CBlockIndex* pindex = NULL;
+                    {
+                        LOCK(cs_main);
+                        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
+                        if (mi != mapBlockIndex.end())
+                            pindex = (*mi).second;
+                    }
+                    if (pindex && ReadBlockMessage(pindex, buf))
+                    {
+                        GetBlockCache().Insert(inv.hash, buf);
+                        fFound = true;
+                    }
+                }
+                if (fFound)
+                {
+                    pfrom->PushSendBuffer(buf);
 
                     // Trigger them to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
                     {
+                        LOCK(cs_main);
                         // Bypass PushInventory, this must send even if redundant,
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
@@ -2616,12 +3634,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             else if (inv.IsKnownType())
             {
                 // Send stream from relay memory
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end())
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                }
+                CSendBuffer buf;
+                if (GetRelayPool().Get(inv, buf))
+                    pfrom->PushSendBuffer(buf);
             }
 
             // Track requests for our stuff
@@ -2688,7 +3703,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         }
 
         vector<CBlock> vHeaders;
-        int nLimit = 2000;
+        int nLimit = MAX_HEADERS_RESULTS;
         printf("getheaders %d to %s\n", (pindex ? pindex->nHeight : -1), hashStop.ToString().substr(0,20).c_str());
         for (; pindex; pindex = pindex->pnext)
         {
@@ -2700,6 +3715,20 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     }
 
 
+    else if (strCommand == "headers")
+    {
+        vector<CBlock> vHeaders;
+        vRecv >> vHeaders;
+        if (vHeaders.size() > MAX_HEADERS_RESULTS)
+        {
+            pfrom->Misbehaving(20);
+            return error("message headers size() = %d", vHeaders.size());
+        }
+        if (fHeadersFirst)
+            ProcessBlockHeaders(pfrom, vHeaders);
+    }
+
+
     else if (strCommand == "tx")
     {
         vector<uint256> vWorkQueue;
@@ -2777,18 +3806,132 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         printf("received block %s\n", block.GetHash().ToString().substr(0,20).c_str());
         // block.print();
 
-        CInv inv(MSG_BLOCK, block.GetHash());
+        ProcessReceivedBlock(pfrom, block);
+    }
+
+
+    else if (strCommand == "cmpctblock")
+    {
+        CCompactBlock cmpctblock;
+        vRecv >> cmpctblock;
+        if (!pfrom->fCompactBlocks)
+            return true;
+
+        uint256 hash = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hash);
         pfrom->AddInventoryKnown(inv);
+        if (mapBlockIndex.count(hash) || mapOrphanBlocks.count(hash))
+            return true;
+        printf("received compact block %s\n", hash.ToString().substr(0,20).c_str());
 
-        if (ProcessBlock(pfrom, &block))
-            mapAlreadyAskedFor.erase(inv);
-        if (block.nDoS) pfrom->Misbehaving(block.nDoS);
+        if (!CheckProofOfWork(cmpctblock.header.GetPoWHash(), cmpctblock.header.nBits))
+        {
+            pfrom->Misbehaving(50);
+            return error("message cmpctblock : proof of work failed");
+        }
+
+        // Only worth putting together on top of a block we have, and with
+        // room to wait for the rest; otherwise fetch it whole
+        int64 nNow = GetTime();
+        for (map<uint256, CPartialBlockRequest>::iterator mi = mapPartialBlocks.begin(); mi != mapPartialBlocks.end();)
+        {
+            if (nNow - (*mi).second.nTime > PARTIAL_BLOCK_TIMEOUT)
+                mapPartialBlocks.erase(mi++);
+            else
+                mi++;
+        }
+        if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock) || mapPartialBlocks.size() >= MAX_PARTIAL_BLOCKS ||
+            mapPartialBlocks.count(hash))
+        {
+            pfrom->PushMessage("getdata", vector<CInv>(1, inv));
+            return true;
+        }
+
+        CPartialBlockRequest request;
+        bool fValid;
+        {
+            LOCK(mempool.cs);
+            fValid = request.partial.Init(cmpctblock, mempool.mapTx);
+        }
+        if (!fValid)
+        {
+            pfrom->Misbehaving(100);
+            return error("message cmpctblock : malformed");
+        }
+
+        vector<unsigned int> vMissing;
+        request.partial.GetMissing(vMissing);
+        if (vMissing.empty())
+            ProcessPartialBlock(pfrom, request.partial);
+        else
+        {
+            if (fDebugNet)
+                printf("compact block %s missing %u of %u transactions\n", hash.ToString().substr(0,20).c_str(),
+                       (unsigned int)vMissing.size(), (unsigned int)(cmpctblock.vShortId.size() + cmpctblock.vPrefilled.size()));
+            request.pnode = pfrom;
+            request.nTime = nNow;
+            mapPartialBlocks[hash] = request;
+            pfrom->PushMessage("getblocktxn", hash, vMissing);
+        }
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        uint256 hash;
+        vector<unsigned int> vIndex;
+        vRecv >> hash >> vIndex;
+
+        // Only blocks recent enough to have been sent compact
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end() || (*mi).second->nHeight < nBestHeight - 10)
+            return true;
+        CBlock block;
+        if (!block.ReadFromDisk((*mi).second))
+            return error("message getblocktxn : ReadFromDisk failed");
+
+        vector<CTransaction> vtx;
+        BOOST_FOREACH(unsigned int nIndex, vIndex)
+        {
+            if (nIndex >= block.vtx.size())
+            {
+                pfrom->Misbehaving(100);
+                return error("message getblocktxn : index %u out of range", nIndex);
+            }
+            vtx.push_back(block.vtx[nIndex]);
+        }
+        pfrom->PushMessage("blocktxn", hash, vtx);
+    }
+
+
+    else if (strCommand == "blocktxn")
+    {
+        uint256 hash;
+        vector<CTransaction> vtx;
+        vRecv >> hash >> vtx;
+
+        map<uint256, CPartialBlockRequest>::iterator mi = mapPartialBlocks.find(hash);
+        if (mi == mapPartialBlocks.end() || (*mi).second.pnode != pfrom)
+            return true;
+        CPartialBlock partial = (*mi).second.partial;
+        mapPartialBlocks.erase(mi);
+
+        if (!partial.FillMissing(vtx))
+        {
+            pfrom->Misbehaving(10);
+            pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+            return error("message blocktxn : expected a different number of transactions");
+        }
+        ProcessPartialBlock(pfrom, partial);
     }
 
 
     else if (strCommand == "getaddr")
     {
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH(const CAddress &addr, vAddr)
             pfrom->PushAddress(addr);
@@ -2897,13 +4040,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     return true;
 }
 
-bool ProcessMessages(CNode* pfrom)
+bool ProcessMessages(CNode* pfrom, bool fMainLock)
 {
-    CDataStream& vRecv = pfrom->vRecv;
-    if (vRecv.empty())
-        return true;
     //if (fDebug)
-    //    printf("ProcessMessages(%u bytes)\n", vRecv.size());
+    //    printf("ProcessMessages(%u messages)\n", pfrom->vRecvMsg.size());
 
     //
     // Message format
@@ -2913,55 +4053,34 @@ bool ProcessMessages(CNode* pfrom)
     //  (4) checksum
     //  (x) data
     //
+    // The socket thread has already framed the messages and checked their
+    // headers; each payload is deserialized straight out of its own buffer.
+    //
+    // Messages that need cs_main are taken one per call, so that a peer
+    // sending lots of blocks or transactions gets its turn along with the
+    // others rather than before them. Without fMainLock, stop at the first
+    // of those and leave it to a thread that may wait for cs_main.
+    //
 
-    loop
+    bool fMainLockUsed = false;
+    std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
+    while (it != pfrom->vRecvMsg.end() && (*it).IsComplete())
     {
         // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->vSend.size() >= SendBufferSize())
+        if (pfrom->nSendSize >= SendBufferSize())
             break;
 
-        // Scan for message start
-        CDataStream::iterator pstart = search(vRecv.begin(), vRecv.end(), BEGIN(pchMessageStart), END(pchMessageStart));
-        int nHeaderSize = vRecv.GetSerializeSize(CMessageHeader());
-        if (vRecv.end() - pstart < nHeaderSize)
-        {
-            if ((int)vRecv.size() > nHeaderSize)
-            {
-                printf("\n\nPROCESSMESSAGE MESSAGESTART NOT FOUND\n\n");
-                vRecv.erase(vRecv.begin(), vRecv.end() - nHeaderSize);
-            }
-            break;
-        }
-        if (pstart - vRecv.begin() > 0)
-            printf("\n\nPROCESSMESSAGE SKIPPED %d BYTES\n\n", pstart - vRecv.begin());
-        vRecv.erase(vRecv.begin(), pstart);
-
-        // Read header
-        vector<char> vHeaderSave(vRecv.begin(), vRecv.begin() + nHeaderSize);
-        CMessageHeader hdr;
-        vRecv >> hdr;
-        if (!hdr.IsValid())
-        {
-            printf("\n\nPROCESSMESSAGE: ERRORS IN HEADER %s\n\n\n", hdr.GetCommand().c_str());
-            continue;
-        }
+        CMessageHeader& hdr = (*it).hdr;
         string strCommand = hdr.GetCommand();
+        bool fNeedsMain = !IsMainLockFree(strCommand);
+        if (fNeedsMain && (fMainLockUsed || !fMainLock))
+            break;
 
-        // Message size
+        CNetMessage& msg = *it++;
         unsigned int nMessageSize = hdr.nMessageSize;
-        if (nMessageSize > MAX_SIZE)
-        {
-            printf("ProcessMessages(%s, %u bytes) : nMessageSize > MAX_SIZE\n", strCommand.c_str(), nMessageSize);
-            continue;
-        }
-        if (nMessageSize > vRecv.size())
-        {
-            // Rewind and wait for rest of message
-            vRecv.insert(vRecv.begin(), vHeaderSave.begin(), vHeaderSave.end());
-            break;
-        }
 
         // Checksum
+        CDataStream& vRecv = msg.vRecv;
         uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
         unsigned int nChecksum = 0;
         memcpy(&nChecksum, &hash, sizeof(nChecksum));
@@ -2972,18 +4091,18 @@ bool ProcessMessages(CNode* pfrom)
             continue;
         }
 
-        // Copy message to its own buffer
-        CDataStream vMsg(vRecv.begin(), vRecv.begin() + nMessageSize, vRecv.nType, vRecv.nVersion);
-        vRecv.ignore(nMessageSize);
-
         // Process message
         bool fRet = false;
         try
         {
+            if (fNeedsMain)
             {
                 LOCK(cs_main);
-                fRet = ProcessMessage(pfrom, strCommand, vMsg);
+                fMainLockUsed = true;
+                fRet = ProcessMessage(pfrom, strCommand, vRecv);
             }
+            else
+                fRet = ProcessMessage(pfrom, strCommand, vRecv);
             if (fShutdown)
                 return true;
         }
@@ -3014,32 +4133,93 @@ bool ProcessMessages(CNode* pfrom)
             printf("ProcessMessage(%s, %u bytes) FAILED\n", strCommand.c_str(), nMessageSize);
     }
 
-    vRecv.Compact();
+    // Drop everything handled in one go
+    pfrom->PopRecvMessages(it);
     return true;
 }
 
 
 bool SendMessages(CNode* pto, bool fSendTrickle)
 {
-    TRY_LOCK(cs_main, lockMain);
-    if (lockMain) {
-        // Don't send anything until we get their version message
-        if (pto->nVersion == 0)
-            return true;
+    // Don't send anything until we have their whole version message
+    if (!pto->fSuccessfullyConnected)
+        return true;
 
-        // Keep-alive ping. We send a nonce of zero because we don't use it anywhere
-        // right now.
-        if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSend.empty()) {
-            uint64 nonce = 0;
-            if (pto->nVersion > BIP0031_VERSION)
-                pto->PushMessage("ping", nonce);
+    // Keep-alive ping. We send a nonce of zero because we don't use it anywhere
+    // right now.
+    if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSendMsg.empty()) {
+        uint64 nonce = 0;
+        if (pto->nVersion > BIP0031_VERSION)
+            pto->PushMessage("ping", nonce);
+        else
+            pto->PushMessage("ping");
+    }
+
+    //
+    // Message: addr
+    //
+    if (fSendTrickle)
+    {
+        vector<CAddress> vAddr;
+        {
+            LOCK(pto->cs_vAddrToSend);
+            vAddr.reserve(pto->vAddrToSend.size());
+            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
+            {
+                // returns true if wasn't already contained in the set
+                if (pto->setAddrKnown.insert(addr).second)
+                    vAddr.push_back(addr);
+            }
+            pto->vAddrToSend.clear();
+        }
+        // receiver rejects addr messages larger than 1000
+        for (unsigned int i = 0; i < vAddr.size(); i += 1000)
+            pto->PushMessage("addr", vector<CAddress>(vAddr.begin() + i, vAddr.begin() + min(i + 1000, (unsigned int)vAddr.size())));
+    }
+
+    //
+    // Message: inventory
+    //
+    vector<CInv> vInv;
+    uint256 hashCompact = 0;
+    CSendBuffer bufCompact;
+    if (pto->fCompactBlocks)
+    {
+        LOCK(cs_compactBlock);
+        hashCompact = hashCompactBlock;
+        bufCompact = bufCompactBlock;
+    }
+    bool fSendCompact = false;
+    {
+        LOCK(pto->cs_inventory);
+        vInv.reserve(pto->vInventoryToSend.size());
+        BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
+        {
+            if (pto->filterInventoryKnown.Contains(inv.hash))
+                continue;
+            pto->filterInventoryKnown.Insert(inv.hash);
+            if (bufCompact && inv.type == MSG_BLOCK && inv.hash == hashCompact)
+                fSendCompact = true;
             else
-                pto->PushMessage("ping");
+                vInv.push_back(inv);
         }
+        pto->vInventoryToSend.clear();
+    }
+    if (fSendCompact)
+        pto->PushSendBuffer(bufCompact);
+    // Relayed transactions, trickled as decided when they were queued
+    GetRelayScheduler().GetInventory(pto, fSendTrickle, vInv);
+    for (unsigned int i = 0; i < vInv.size(); i += 1000)
+        pto->PushMessage("inv", vector<CInv>(vInv.begin() + i, vInv.begin() + min(i + 1000, (unsigned int)vInv.size())));
 
+    TRY_LOCK(cs_main, lockMain);
+    if (lockMain) {
         // Resend wallet transactions that haven't gotten in a block yet
         ResendWalletTransactions();
 
+        // Sweep small wallet outputs together while it's quiet
+        ConsolidateWalletCoins();
+
         // Address refresh broadcast
         static int64 nLastRebroadcast;
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
@@ -3050,7 +4230,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 {
                     // Periodically clear setAddrKnown to allow refresh broadcasts
                     if (nLastRebroadcast)
+                    {
+                        LOCK(pnode->cs_vAddrToSend);
                         pnode->setAddrKnown.clear();
+                    }
 
                     // Rebroadcast our address
                     if (!fNoListen)
@@ -3064,89 +4247,12 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             nLastRebroadcast = GetTime();
         }
 
-        //
-        // Message: addr
-        //
-        if (fSendTrickle)
-        {
-            vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
-            {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second)
-                {
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
-                    {
-                        pto->PushMessage("addr", vAddr);
-                        vAddr.clear();
-                    }
-                }
-            }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                pto->PushMessage("addr", vAddr);
-        }
-
 
         //
-        // Message: inventory
+        // Message: getheaders, and getdata for the header chain
         //
-        vector<CInv> vInv;
-        vector<CInv> vInvWait;
-        {
-            LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
-            BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
-            {
-                if (pto->setInventoryKnown.count(inv))
-                    continue;
-
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle)
-                {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
-
-                    // always trickle our own transactions
-                    if (!fTrickleWait)
-                    {
-                        CWalletTx wtx;
-                        if (GetTransaction(inv.hash, wtx))
-                            if (wtx.fFromMe)
-                                fTrickleWait = true;
-                    }
-
-                    if (fTrickleWait)
-                    {
-                        vInvWait.push_back(inv);
-                        continue;
-                    }
-                }
-
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
-                {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
-                }
-            }
-            pto->vInventoryToSend = vInvWait;
-        }
-        if (!vInv.empty())
-            pto->PushMessage("inv", vInv);
+        if (fHeadersFirst)
+            SendHeadersFirstRequests(pto);
 
 
         //
@@ -3266,29 +4372,6 @@ unsigned int static ScanHash_CryptoPP(char* pmidstate, char* pdata, char* phash1
     }
 }
 
-// Some explaining would be appreciated
-class COrphan
-{
-public:
-    CTransaction* ptx;
-    set<uint256> setDependsOn;
-    double dPriority;
-
-    COrphan(CTransaction* ptxIn)
-    {
-        ptx = ptxIn;
-        dPriority = 0;
-    }
-
-    void print() const
-    {
-        printf("COrphan(hash=%s, dPriority=%.1f)\n", ptx->GetHash().ToString().substr(0,10).c_str(), dPriority);
-        BOOST_FOREACH(uint256 hash, setDependsOn)
-            printf("   setDependsOn %s\n", hash.ToString().substr(0,10).c_str());
-    }
-};
-
-
 uint64 nLastBlockTx = 0;
 uint64 nLastBlockSize = 0;
 
@@ -3317,83 +4400,75 @@ CBlock* CreateNewBlock(CReserveKey& reservekey)
         LOCK2(cs_main, mempool.cs);
         CTxDB txdb("r");
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        multimap<double, CTransaction*> mapPriority;
-        for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
-        {
-            CTransaction& tx = (*mi).second;
-            if (tx.IsCoinBase() || !tx.IsFinal())
-                continue;
+        // Priorities, fees and sizes are kept up to date by the pool as
+        // transactions arrive, so this only reads inputs for the
+        // transactions that actually make it into the block
+        mempool.UpdateTemplateIndex(txdb);
+        int nHeight = mempool.pindexTemplate->nHeight;
 
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                // Read prev transaction
-                CTransaction txPrev;
-                CTxIndex txindex;
-                if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
-                {
-                    // Has to wait for dependencies
-                    if (!porphan)
-                    {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    continue;
-                }
-                int64 nValueIn = txPrev.vout[txin.prevout.n].nValue;
-
-                // Read block header
-                int nConf = txindex.GetDepthInMainChain();
+        // Transactions with unconfirmed parents wait until all of those are
+        // in the block, then join the walk in priority order
+        map<uint256, vector<uint256> > mapDependers;
+        map<uint256, set<uint256> > mapDependsLeft;
+        multimap<double, uint256> mapReady;
+        set<uint256> setInBlock;
 
-                dPriority += (double)nValueIn * nConf;
+        // Collect transactions into block
+        map<uint256, CTxIndex> mapTestPool;
+        uint64 nBlockSize = 1000;
+        uint64 nBlockTx = 0;
+        int nBlockSigOps = 100;
+        multimap<double, uint256>::const_iterator mp = mempool.mapTemplatePriority.begin();
+        while (true)
+        {
+            // No room left for even the smallest transaction
+            if (nBlockSize + 100 >= MAX_BLOCK_SIZE_GEN)
+                break;
 
-                if (fDebug && GetBoolArg("-printpriority"))
-                    printf("priority     nValueIn=%-12"PRI64d" nConf=%-5d dPriority=%-20.1f\n", nValueIn, nConf, dPriority);
+            // Take highest priority transaction off the index or the ready queue
+            uint256 hash;
+            if (!mapReady.empty() && (mp == mempool.mapTemplatePriority.end() || (*mapReady.begin()).first < (*mp).first))
+            {
+                hash = (*mapReady.begin()).second;
+                mapReady.erase(mapReady.begin());
             }
-
-            // Priority is sum(valuein * age) / txsize
-            dPriority /= ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-
-            if (porphan)
-                porphan->dPriority = dPriority;
+            else if (mp != mempool.mapTemplatePriority.end())
+                hash = (*mp++).second;
             else
-                mapPriority.insert(make_pair(-dPriority, &(*mi).second));
+                break;
 
-            if (fDebug && GetBoolArg("-printpriority"))
+            map<uint256, CTxTemplateInfo>::const_iterator mi = mempool.mapTemplateInfo.find(hash);
+            if (mi == mempool.mapTemplateInfo.end())
+                continue;
+            const CTxTemplateInfo& info = (*mi).second;
+            CTransaction& tx = mempool.mapTx[hash];
+            if (tx.IsCoinBase() || !tx.IsFinal())
+                continue;
+
+            // Has to wait for dependencies
+            set<uint256> setDependsLeft;
+            BOOST_FOREACH(const uint256& hashParent, info.setDependsOn)
+                if (!setInBlock.count(hashParent))
+                    setDependsLeft.insert(hashParent);
+            if (!setDependsLeft.empty())
             {
-                printf("priority %-20.1f %s\n%s", dPriority, tx.GetHash().ToString().substr(0,10).c_str(), tx.ToString().c_str());
-                if (porphan)
-                    porphan->print();
-                printf("\n");
+                BOOST_FOREACH(const uint256& hashParent, setDependsLeft)
+                    mapDependers[hashParent].push_back(hash);
+                mapDependsLeft[hash].swap(setDependsLeft);
+                continue;
             }
-        }
 
-        // Collect transactions into block
-        map<uint256, CTxIndex> mapTestPool;
-        uint64 nBlockSize = 1000;
-        uint64 nBlockTx = 0;
-        int nBlockSigOps = 100;
-        while (!mapPriority.empty())
-        {
-            // Take highest priority transaction off priority queue
-            double dPriority = -(*mapPriority.begin()).first;
-            CTransaction& tx = *(*mapPriority.begin()).second;
-            mapPriority.erase(mapPriority.begin());
+            double dPriority = info.GetPriority(nHeight);
+            if (fDebug && GetBoolArg("-printpriority"))
+                printf("priority %-20.1f %s\n%s\n", dPriority, hash.ToString().substr(0,10).c_str(), tx.ToString().c_str());
 
             // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = info.nTxSize;
             if (nBlockSize + nTxSize >= MAX_BLOCK_SIZE_GEN)
                 continue;
 
             // Legacy limits on sigOps:
-            unsigned int nTxSigOps = tx.GetLegacySigOpCount();
+            unsigned int nTxSigOps = info.nLegacySigOps;
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
                 continue;
 
@@ -3401,13 +4476,14 @@ CBlock* CreateNewBlock(CReserveKey& reservekey)
             // Litecoind: Reduce the exempted free transactions to 500 bytes (from Bitcoin's 3000 bytes)
             bool fAllowFree = (nBlockSize + nTxSize < 1500 || CTransaction::AllowFree(dPriority));
             int64 nMinFee = tx.GetMinFee(nBlockSize, fAllowFree, GMF_BLOCK);
+            if (info.nFees < nMinFee)
+                continue;
 
             // Connecting shouldn't fail due to dependency on other memory pool transactions
             // because we're already processing them in order of dependency
-            map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
             MapPrevTx mapInputs;
             bool fInvalid;
-            if (!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
+            if (!tx.FetchInputs(txdb, mapTestPool, false, true, mapInputs, fInvalid))
                 continue;
 
             int64 nTxFees = tx.GetValueIn(mapInputs)-tx.GetValueOut();
@@ -3418,10 +4494,27 @@ CBlock* CreateNewBlock(CReserveKey& reservekey)
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
                 continue;
 
-            if (!tx.ConnectInputs(mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true))
+            // ConnectInputs marks outputs spent in mapTestPool as it goes;
+            // remember the entries it can touch to roll back a failure
+            vector<pair<uint256, CTxIndex> > vUndo;
+            vector<uint256> vUndoErase;
+            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            {
+                map<uint256, CTxIndex>::iterator mt = mapTestPool.find(txin.prevout.hash);
+                if (mt != mapTestPool.end())
+                    vUndo.push_back(*mt);
+                else
+                    vUndoErase.push_back(txin.prevout.hash);
+            }
+            if (!tx.ConnectInputs(mapInputs, mapTestPool, CDiskTxPos(1,1,1), pindexPrev, false, true))
+            {
+                BOOST_FOREACH(const uint256& hashPrev, vUndoErase)
+                    mapTestPool.erase(hashPrev);
+                for (unsigned int i = 0; i < vUndo.size(); i++)
+                    mapTestPool[vUndo[i].first] = vUndo[i].second;
                 continue;
-            mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
-            swap(mapTestPool, mapTestPoolTmp);
+            }
+            mapTestPool[hash] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
 
             // Added
             pblock->vtx.push_back(tx);
@@ -3429,20 +4522,25 @@ CBlock* CreateNewBlock(CReserveKey& reservekey)
             ++nBlockTx;
             nBlockSigOps += nTxSigOps;
             nFees += nTxFees;
+            setInBlock.insert(hash);
 
-            // Add transactions that depend on this one to the priority queue
-            uint256 hash = tx.GetHash();
-            if (mapDependers.count(hash))
+            // Release transactions that were only waiting for this one
+            map<uint256, vector<uint256> >::iterator md = mapDependers.find(hash);
+            if (md != mapDependers.end())
             {
-                BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
+                BOOST_FOREACH(const uint256& hashChild, (*md).second)
                 {
-                    if (!porphan->setDependsOn.empty())
+                    map<uint256, set<uint256> >::iterator ml = mapDependsLeft.find(hashChild);
+                    if (ml == mapDependsLeft.end())
+                        continue;
+                    (*ml).second.erase(hash);
+                    if ((*ml).second.empty())
                     {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty())
-                            mapPriority.insert(make_pair(-porphan->dPriority, porphan->ptx));
+                        mapDependsLeft.erase(ml);
+                        mapReady.insert(make_pair(-mempool.mapTemplateInfo[hashChild].GetPriority(nHeight), hashChild));
                     }
                 }
+                mapDependers.erase(md);
             }
         }
 
@@ -3570,7 +4668,28 @@ static bool fGenerateBitcoins = false;
 static bool fLimitProcessors = false;
 static int nLimitProcessors = -1;
 
-void static BitcoinMiner(CWallet *pwallet)
+// Scrypt scratchpad of one miner thread.  It is allocated and first touched
+// by the (already pinned) thread using it, so it lives on that thread's NUMA
+// node, and it is backed by huge pages where available to save TLB misses.
+class CMinerScratchpad
+{
+public:
+    char* p;
+
+    CMinerScratchpad()
+    {
+        p = (char*)AllocHugePages(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+        if (p)
+            memset(p, 0, SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    }
+
+    ~CMinerScratchpad()
+    {
+        FreeHugePages(p, SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    }
+};
+
+void static BitcoinMiner(CWallet *pwallet, CHashMeter* pmeter, int nSlot)
 {
     printf("BitcoinMiner started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
@@ -3578,10 +4697,30 @@ void static BitcoinMiner(CWallet *pwallet)
     // Make this thread recognisable as the mining thread
     RenameThread("bitcoin-miner");
 
+    // Pin to one core before touching the scratchpad
+    if (GetBoolArg("-mineraffinity", true))
+    {
+        int nProcessors = boost::thread::hardware_concurrency();
+        if (nProcessors < 1)
+            nProcessors = 1;
+        if (!SetThreadAffinity(nSlot % nProcessors))
+            printf("BitcoinMiner : could not pin thread %d to a core\n", nSlot);
+    }
+
     // Each thread has its own key and counter
     CReserveKey reservekey(pwallet);
     unsigned int nExtraNonce = 0;
 
+    // Hash nonces in batches through the widest scrypt kernel available
+    int nWays = scrypt_best_throughput();
+    CMinerScratchpad scratchpad;
+    if (!scratchpad.p)
+    {
+        printf("BitcoinMiner : failed to allocate scrypt scratchpad\n");
+        return;
+    }
+    printf("BitcoinMiner thread %d using %d-way scrypt\n", nSlot, nWays);
+
     while (fGenerateBitcoins)
     {
         if (fShutdown)
@@ -3634,54 +4773,49 @@ void static BitcoinMiner(CWallet *pwallet)
             unsigned int nHashesDone = 0;
             //unsigned int nNonceFound;
 
-            uint256 thash;
-            char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
-            loop
+            char pheaders[80 * SCRYPT_MAX_WAYS];
+            uint256 thash[SCRYPT_MAX_WAYS];
+            for (int i = 0; i < nWays; i++)
+                memcpy(&pheaders[80 * i], BEGIN(pblock->nVersion), 80);
+            bool fFound = false;
+            while (!fFound)
             {
-                scrypt_1024_1_1_256_sp(BEGIN(pblock->nVersion), BEGIN(thash), scratchpad);
+                unsigned int nNonceBase = pblock->nNonce;
+                for (int i = 0; i < nWays; i++)
+                    *(unsigned int*)&pheaders[80 * i + 76] = nNonceBase + i;
+                scrypt_1024_1_1_256_sp_multi(pheaders, BEGIN(thash), scratchpad.p, nWays, (unsigned int*)pmidstate);
 
-                if (thash <= hashTarget)
+                for (int i = 0; i < nWays && !fFound; i++)
                 {
-                    // Found a solution
-                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                    CheckWork(pblock.get(), *pwalletMain, reservekey);
-                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                    break;
+                    if (thash[i] <= hashTarget)
+                    {
+                        // Found a solution
+                        pblock->nNonce = nNonceBase + i;
+                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                        CheckWork(pblock.get(), *pwalletMain, reservekey);
+                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
+                        pblock->nNonce = nNonceBase;
+                        fFound = true;
+                    }
                 }
-                pblock->nNonce += 1;
-                nHashesDone += 1;
+                if (fFound)
+                    break;
+                pblock->nNonce += nWays;
+                nHashesDone += nWays;
                 if ((pblock->nNonce & 0xFF) == 0)
                     break;
             }
 
             // Meter hashes/sec
-            static int64 nHashCounter;
-            if (nHPSTimerStart == 0)
-            {
-                nHPSTimerStart = GetTimeMillis();
-                nHashCounter = 0;
-            }
-            else
-                nHashCounter += nHashesDone;
-            if (GetTimeMillis() - nHPSTimerStart > 4000)
+            pmeter->Add(nHashesDone, GetTimeMillis());
+            if (nSlot == 0)
             {
-                static CCriticalSection cs;
+                static int64 nLogTime;
+                if (GetTime() - nLogTime > 30 * 60)
                 {
-                    LOCK(cs);
-                    if (GetTimeMillis() - nHPSTimerStart > 4000)
-                    {
-                        dHashesPerSec = 1000.0 * nHashCounter / (GetTimeMillis() - nHPSTimerStart);
-                        nHPSTimerStart = GetTimeMillis();
-                        nHashCounter = 0;
-                        string strStatus = strprintf("    %.0f khash/s", dHashesPerSec/1000.0);
-                        static int64 nLogTime;
-                        if (GetTime() - nLogTime > 30 * 60)
-                        {
-                            nLogTime = GetTime();
-                            printf("%s ", DateTimeStrFormat("%x %H:%M", GetTime()).c_str());
-                            printf("hashmeter %3d CPUs %6.0f khash/s\n", vnThreadsRunning[THREAD_MINER], dHashesPerSec/1000.0);
-                        }
-                    }
+                    nLogTime = GetTime();
+                    printf("%s ", DateTimeStrFormat("%x %H:%M", GetTime()).c_str());
+                    printf("hashmeter %3d CPUs %6.0f khash/s\n", vnThreadsRunning[THREAD_MINER], GetHashesPerSec(HASHMETER_WINDOW_60S)/1000.0);
                 }
             }
 
@@ -3717,10 +4851,17 @@ void static BitcoinMiner(CWallet *pwallet)
 void static ThreadBitcoinMiner(void* parg)
 {
     CWallet* pwallet = (CWallet*)parg;
+    int nSlot;
+    CHashMeter* pmeter = ClaimHashMeter(nSlot);
+    if (!pmeter)
+    {
+        printf("ThreadBitcoinMiner exiting, no free hash meter slot\n");
+        return;
+    }
     try
     {
         vnThreadsRunning[THREAD_MINER]++;
-        BitcoinMiner(pwallet);
+        BitcoinMiner(pwallet, pmeter, nSlot);
         vnThreadsRunning[THREAD_MINER]--;
     }
     catch (std::exception& e) {
@@ -3730,9 +4871,7 @@ void static ThreadBitcoinMiner(void* parg)
         vnThreadsRunning[THREAD_MINER]--;
         PrintException(NULL, "ThreadBitcoinMiner()");
     }
-    nHPSTimerStart = 0;
-    if (vnThreadsRunning[THREAD_MINER] == 0)
-        dHashesPerSec = 0;
+    ReleaseHashMeter(nSlot);
     printf("ThreadBitcoinMiner exiting, %d threads remaining\n", vnThreadsRunning[THREAD_MINER]);
 }
 
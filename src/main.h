@@ -71,8 +71,6 @@ extern unsigned int nTransactionsUpdated;
 extern uint64 nLastBlockTx;
 extern uint64 nLastBlockSize;
 extern const std::string strMessageMagic;
-extern double dHashesPerSec;
-extern int64 nHPSTimerStart;
 extern int64 nTimeBestReceived;
 extern CCriticalSection cs_setpwalletRegistered;
 extern std::set<CWallet*> setpwalletRegistered;
@@ -85,10 +83,18 @@ extern int64 nMinimumInputValue;
 // Minimum disk space required - used in CheckDiskSpace()
 static const uint64 nMinDiskSpace = 52428800;
 
+// Maximum number of script-checking threads allowed
+static const int MAX_SCRIPTCHECK_THREADS = 16;
+// Number of threads (including the one connecting the block) verifying scripts
+extern int nScriptCheckThreads;
+// Download the header chain first, then blocks from several peers at once
+extern bool fHeadersFirst;
+
 
 class CReserveKey;
 class CTxDB;
 class CTxIndex;
+class CScriptCheck;
 
 void RegisterWallet(CWallet* pwalletIn);
 void UnregisterWallet(CWallet* pwalletIn);
@@ -99,9 +105,10 @@ FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszM
 FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
-bool ProcessMessages(CNode* pfrom);
+bool ProcessMessages(CNode* pfrom, bool fMainLock=true);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 bool LoadExternalBlockFile(FILE* fileIn);
+bool FlushBlockIndexBatch(CTxDB& txdb, bool fForce);
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet);
 CBlock* CreateNewBlock(CReserveKey& reservekey);
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
@@ -114,6 +121,8 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock);
 bool GetNonWalletTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock);
+void ThreadScriptCheck(void* parg);
+void StopScriptCheckThreads();
 
 
 
@@ -346,7 +355,7 @@ public:
         scriptPubKey.clear();
     }
 
-    bool IsNull()
+    bool IsNull() const
     {
         return (nValue == -1);
     }
@@ -689,11 +698,13 @@ public:
         @param[in] fBlock	true if called from ConnectBlock
         @param[in] fMiner	true if called from CreateNewBlock
         @param[in] fStrictPayToScriptHash	true if fully validating p2sh transactions
+        @param[out] pvChecks	if not NULL, script checks are appended here instead of being run
         @return Returns true if all checks succeed
      */
     bool ConnectInputs(MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true,
+                       std::vector<CScriptCheck>* pvChecks = NULL);
     bool ClientConnectInputs();
     bool CheckTransaction() const;
     bool AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs=true, bool* pfMissingInputs=NULL);
@@ -758,6 +769,41 @@ public:
 
 
 
+/** Closure representing one script verification.
+ *  Holds its own copy of the output being spent, so it stays valid after
+ *  the inputs fetched for ConnectInputs are gone; the spending transaction
+ *  must outlive it.
+ */
+class CScriptCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction* ptxTo;
+    unsigned int nIn;
+    bool fStrictPayToScriptHash;
+    int nHashType;
+
+public:
+    CScriptCheck() : ptxTo(NULL), nIn(0), fStrictPayToScriptHash(false), nHashType(0) {}
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, bool fStrictPayToScriptHashIn, int nHashTypeIn) :
+        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+        ptxTo(&txToIn), nIn(nInIn), fStrictPayToScriptHash(fStrictPayToScriptHashIn), nHashType(nHashTypeIn) {}
+
+    bool operator()() const;
+
+    void swap(CScriptCheck& check)
+    {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(fStrictPayToScriptHash, check.fStrictPayToScriptHash);
+        std::swap(nHashType, check.nHashType);
+    }
+};
+
+
+
+
 /**  A txdb record that contains the disk location of a transaction and the
  * locations of transactions that spend its outputs.  vSpent is really only
  * used as a flag, but having the location is very helpful for debugging.
@@ -815,6 +861,119 @@ public:
 
 
 
+/** Outputs of a confirmed transaction, kept so inputs can be checked
+ * without reading the whole transaction back from the block files.
+ * Outputs known to be spent are pruned to null.  CTxIndex::vSpent stays
+ * the authority on spentness: an entry that is missing, pruned too eagerly
+ * or left behind by a failed block only costs a disk read.
+ */
+class CCoins
+{
+public:
+    bool fCoinBase;
+    int nHeight;    // height of the block that confirmed it, -1 if unknown
+    std::vector<CTxOut> vout;
+
+    CCoins()
+    {
+        fCoinBase = false;
+        nHeight = -1;
+    }
+
+    CCoins(const CTransaction& tx, int nHeightIn) : vout(tx.vout)
+    {
+        fCoinBase = tx.IsCoinBase();
+        nHeight = nHeightIn;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(fCoinBase);
+        READWRITE(nHeight);
+        READWRITE(vout);
+    )
+
+    bool IsAvailable(unsigned int n) const
+    {
+        return n < vout.size() && !vout[n].IsNull();
+    }
+
+    bool IsPruned() const
+    {
+        BOOST_FOREACH(const CTxOut& txout, vout)
+            if (!txout.IsNull())
+                return false;
+        return true;
+    }
+
+    void Spend(unsigned int n)
+    {
+        if (n < vout.size())
+            vout[n].SetNull();
+        // Spent outputs at the end don't need a placeholder
+        while (!vout.empty() && vout.back().IsNull())
+            vout.pop_back();
+    }
+
+    /** Stand-in for the transaction with nOutputs outputs, carrying what
+     *  ConnectInputs and GetOutputFor look at: the outputs and whether it
+     *  is a coinbase.  Its hash is not the original's. */
+    void GetTransaction(CTransaction& tx, unsigned int nOutputs) const
+    {
+        tx.SetNull();
+        if (fCoinBase)
+        {
+            tx.vin.resize(1);
+            tx.vin[0].prevout.SetNull();
+        }
+        tx.vout = vout;
+        tx.vout.resize(nOutputs);
+    }
+};
+
+/** Write-back cache of CCoins in front of blkindex.dat, sized by -dbcache.
+ *  Changes stay in memory until the cache outgrows its budget or the node
+ *  shuts down; losing them only costs disk reads, see CCoins. */
+class CCoinsCache
+{
+public:
+    CCoinsCache();
+
+    /** Cached entry for hash, read through from txdb on a miss */
+    bool GetCoins(CTxDB& txdb, const uint256& hash, CCoins& coins);
+    void SetCoins(const uint256& hash, const CCoins& coins);
+    /** Prune prevout if its transaction is cached */
+    void SpendCoins(const COutPoint& prevout);
+    void EraseCoins(const uint256& hash);
+    /** Write dirty entries to txdb and empty the cache if it holds more than
+     *  its budget, or always with fForce.  Must not be inside a txdb transaction. */
+    bool Flush(CTxDB& txdb, bool fForce);
+
+    void SetMaxSize(int64 nMaxSizeIn) { nMaxSize = nMaxSizeIn; }
+    int64 GetSize() const { return nSize; }
+
+private:
+    struct CEntry
+    {
+        CCoins coins;
+        bool fDirty;
+        bool fErased;
+        unsigned int nSize;
+    };
+
+    void Put(const uint256& hash, const CCoins& coins, bool fDirty, bool fErased);
+
+    mutable CCriticalSection cs;
+    std::map<uint256, CEntry> mapCoins;
+    int64 nSize;
+    int64 nMaxSize;
+};
+
+extern CCoinsCache coinscache;
+
+
+
+
 
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
@@ -1306,6 +1465,13 @@ public:
         vHave = vHaveIn;
     }
 
+    /** Headers we have ahead of pindex, newest first, followed by the usual locator for pindex */
+    CBlockLocator(const std::vector<uint256>& vHeaderHashes, const CBlockIndex* pindex)
+    {
+        Set(pindex);
+        vHave.insert(vHave.begin(), vHeaderHashes.begin(), vHeaderHashes.end());
+    }
+
     IMPLEMENT_SERIALIZE
     (
         if (!(nType & SER_GETHASH))
@@ -1403,6 +1569,151 @@ public:
 };
 
 
+/** Block bodies still to be fetched for a header chain that is ahead of
+ * our blocks.  Requests are spread over several peers, at most nMaxPerPeer
+ * blocks each, and never reach more than nWindow blocks past the first one
+ * we are missing, so a slow peer can only hold up its own few blocks while
+ * the others keep the window moving.  A peer is referenced while it has
+ * blocks outstanding.
+ */
+class CBlockDownload
+{
+public:
+    CBlockDownload(int nWindowIn, int nMaxPerPeerIn);
+
+    /** Replace the header chain with vHashIn, which builds on hashBaseIn at nBaseHeightIn */
+    void SetChain(const uint256& hashBaseIn, int nBaseHeightIn, const std::vector<uint256>& vHashIn, const CBigNum& bnWorkIn);
+    /** Add headers that build on the tip */
+    void Extend(const std::vector<uint256>& vHashIn, const CBigNum& bnWorkIn);
+    /** Forget the headers up to a block that is now in the best chain */
+    void SetConnected(int nHeight, const uint256& hash);
+    void Clear();
+
+    bool IsEmpty() const { return vHash.empty(); }
+    bool Contains(const uint256& hash) const { return setHash.count(hash) > 0; }
+    int GetTipHeight() const { return nBaseHeight + vHash.size(); }
+    uint256 GetTipHash() const { return vHash.empty() ? hashBase : vHash.back(); }
+    const uint256& GetBaseHash() const { return hashBase; }
+    const CBigNum& GetWork() const { return bnWork; }
+    /** Header hashes from the tip back towards the base, thinning out, for a locator */
+    std::vector<uint256> GetLocatorHashes() const;
+
+    /** Pick blocks for pnode to fetch, none above nMaxHeight */
+    void GetRequests(CNode* pnode, int nMaxHeight, int64 nNow, std::vector<CInv>& vGetData);
+    /** A block arrived; fValid unless it was rejected and should be fetched again */
+    void BlockReceived(const uint256& hash, bool fValid);
+    /** Give up on requests older than nTimeout or to peers that went away, noting who had them */
+    void ExpireRequests(int64 nNow, int64 nTimeout, std::set<CNode*>& setStalled);
+    int GetInFlight(CNode* pnode) const;
+    int GetInFlight() const { return mapInFlight.size(); }
+
+private:
+    typedef std::map<uint256, std::pair<CNode*, int64> > InFlightMap;
+
+    void ReleaseRequest(InFlightMap::iterator it);
+
+    int nWindow;
+    int nMaxPerPeer;
+    uint256 hashBase;
+    int nBaseHeight;
+    std::deque<uint256> vHash; // vHash[i] is at height nBaseHeight + 1 + i
+    std::set<uint256> setHash;
+    CBigNum bnWork;
+    std::set<uint256> setReceived;
+    unsigned int nFirstMissing; // nothing before this position is still to be received
+    InFlightMap mapInFlight;
+    std::map<CNode*, int> mapPeerInFlight;
+};
+
+
+
+/** A 48 bit transaction id, salted per block so that nobody can make two
+ *  transactions that collide in every block */
+class CShortTxId
+{
+public:
+    uint64 n;
+
+    CShortTxId() { n = 0; }
+    CShortTxId(uint64 nIn) { n = nIn & 0xffffffffffffULL; }
+
+    IMPLEMENT_SERIALIZE
+    (
+        unsigned int nLow = n & 0xffffffff;
+        unsigned short nHigh = n >> 32;
+        READWRITE(nLow);
+        READWRITE(nHigh);
+        if (fRead)
+            const_cast<CShortTxId*>(this)->n = nLow | (uint64)nHigh << 32;
+    )
+};
+
+/** A transaction sent whole in a compact block, with its place in the block */
+class CPrefilledTx
+{
+public:
+    unsigned int nIndex;
+    CTransaction tx;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nIndex);
+        READWRITE(tx);
+    )
+};
+
+/** A new block as its header and the short ids of its transactions.
+ * Peers that negotiated compact blocks in their version messages get this
+ * instead of an inv.  They will have almost all the transactions in their
+ * memory pool already, and only ask for the rest with getblocktxn.  The
+ * coinbase can't be in anyone's pool, so it is sent whole.
+ */
+class CCompactBlock
+{
+public:
+    CBlock header;
+    uint64 nNonce;
+    std::vector<CShortTxId> vShortId;
+    std::vector<CPrefilledTx> vPrefilled;
+
+    CCompactBlock() { nNonce = 0; }
+    CCompactBlock(const CBlock& block);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(header);
+        READWRITE(nNonce);
+        READWRITE(vShortId);
+        READWRITE(vPrefilled);
+    )
+
+    /** Short ids are salted with the block hash and nNonce */
+    uint256 GetSalt() const;
+    static uint64 GetShortTxId(const uint256& salt, const uint256& hashTx);
+};
+
+/** A block being put together from a compact block and the memory pool */
+class CPartialBlock
+{
+public:
+    /** Place the prefilled transactions and whatever mapPool has of the
+     *  rest.  False if the compact block is malformed. */
+    bool Init(const CCompactBlock& cmpctblock, const std::map<uint256, CTransaction>& mapPool);
+    /** Positions of the transactions still to be asked for */
+    void GetMissing(std::vector<unsigned int>& vIndex) const;
+    /** Fill in the transactions asked for, in the order GetMissing gave */
+    bool FillMissing(const std::vector<CTransaction>& vtx);
+    /** The whole block, if everything is there and the merkle root matches */
+    bool GetBlock(CBlock& blockRet) const;
+
+    uint256 GetHash() const { return block.GetHash(); }
+
+private:
+    CBlock block;
+    std::vector<bool> vHave;
+};
+
+
 
 
 
@@ -1615,6 +1926,38 @@ public:
     static CAlert getAlertByHash(const uint256 &hash);
 };
 
+/** What CreateNewBlock needs to know about a memory pool transaction.
+ * Input values and heights are read from disk once, when the transaction
+ * enters the pool (or when one of its unconfirmed parents is mined), so the
+ * priority at any later height can be computed without touching the disk.
+ */
+class CTxTemplateInfo
+{
+public:
+    double dValueIn;        // sum of confirmed input values
+    double dValueInHeight;  // sum of confirmed input values * (their block height - 1)
+    int64 nFees;
+    unsigned int nTxSize;
+    unsigned int nLegacySigOps;
+    std::set<uint256> setDependsOn; // unconfirmed parents in the pool
+    std::multimap<double, uint256>::iterator itPriority;
+
+    CTxTemplateInfo()
+    {
+        dValueIn = 0;
+        dValueInHeight = 0;
+        nFees = 0;
+        nTxSize = 0;
+        nLegacySigOps = 0;
+    }
+
+    // Priority is sum(valuein * age) / txsize, age counted in confirmations
+    double GetPriority(int nHeight) const
+    {
+        return (dValueIn * nHeight - dValueInHeight) / nTxSize;
+    }
+};
+
 class CTxMemPool
 {
 public:
@@ -1622,12 +1965,34 @@ public:
     std::map<uint256, CTransaction> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
 
+    // Block template index, maintained incrementally as transactions come
+    // and go.  mapTemplatePriority orders the pool by descending priority at
+    // the height of pindexTemplate; transactions whose inputs could not all
+    // be found yet are left out of it.
+    std::map<uint256, CTxTemplateInfo> mapTemplateInfo;
+    std::multimap<double, uint256> mapTemplatePriority;
+    std::set<uint256> setTemplateDirty;
+    CBlockIndex* pindexTemplate;
+
+    CTxMemPool()
+    {
+        pindexTemplate = NULL;
+    }
+
     bool accept(CTxDB& txdb, CTransaction &tx,
                 bool fCheckInputs, bool* pfMissingInputs);
     bool addUnchecked(const uint256& hash, CTransaction &tx);
     bool remove(CTransaction &tx);
     void queryHashes(std::vector<uint256>& vtxid);
+    /** Bring the block template index up to date with pindexBest and the
+     *  transactions added or removed since the last call.  Requires cs_main. */
+    void UpdateTemplateIndex(CTxDB& txdb);
+
+private:
+    void EraseTemplateInfo(const uint256& hash);
+    void MarkSpendersTemplateDirty(const uint256& hash, const CTransaction& tx);
 
+public:
     unsigned long size()
     {
         LOCK(cs);
@@ -14,6 +14,12 @@
 
 #ifdef WIN32
 #include <string.h>
+#else
+#include <sys/uio.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -30,6 +36,7 @@ static const int MAX_OUTBOUND_CONNECTIONS = 8;
 
 void ThreadMessageHandler2(void* parg);
 void ThreadSocketHandler2(void* parg);
+static void SocketEngineAdd(CNode* pnode);
 void ThreadOpenConnections2(void* parg);
 void ThreadOpenAddedConnections2(void* parg);
 
@@ -57,13 +64,13 @@ static CNode* pnodeLocalHost = NULL;
 uint64 nLocalHostNonce = 0;
 array<int, THREAD_MAX> vnThreadsRunning;
 static std::vector<SOCKET> vhListenSocket;
+#ifdef __linux__
+static int hEpoll = -1;
+#endif
 CAddrMan addrman;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
-deque<pair<int64, CInv> > vRelayExpiration;
-CCriticalSection cs_mapRelay;
 map<CInv, int64> mapAlreadyAskedFor;
 
 static deque<string> vOneShots;
@@ -73,6 +80,7 @@ set<CNetAddr> setservAddNodeAddresses;
 CCriticalSection cs_setservAddNodeAddresses;
 
 static CSemaphore *semOutbound = NULL;
+static int nMessageHandlerThreads = 1;
 
 void AddOneShot(string strDest)
 {
@@ -516,6 +524,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, int64 nTimeout)
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            SocketEngineAdd(pnode);
         }
 
         pnode->nTimeConnected = GetTime();
@@ -535,12 +544,118 @@ void CNode::CloseSocketDisconnect()
         printf("disconnecting node %s\n", addrName.c_str());
         closesocket(hSocket);
         hSocket = INVALID_SOCKET;
-        vRecv.clear();
     }
 }
 
 void CNode::Cleanup()
 {
+    // Free the receive buffer now rather than when the node is deleted,
+    // unless the message handler is still working through it
+    TRY_LOCK(cs_vRecv, lockRecv);
+    if (lockRecv)
+        PopRecvMessages(vRecvMsg.end());
+}
+
+
+char* CNetMessage::GetDataSpace(unsigned int& nSpace)
+{
+    if (nDataPos == vRecv.size() && vRecv.size() < hdr.nMessageSize)
+        vRecv.resize(min(hdr.nMessageSize, nDataPos + 256 * 1024));
+    nSpace = vRecv.size() - nDataPos;
+    return (nSpace > 0 ? &vRecv[nDataPos] : NULL);
+}
+
+int CNetMessage::ReadHeader(const char* pch, unsigned int nBytes)
+{
+    unsigned int nCopy = min(nBytes, (unsigned int)sizeof(pchHeader) - nHeaderPos);
+    memcpy(&pchHeader[nHeaderPos], pch, nCopy);
+    nHeaderPos += nCopy;
+    if (nHeaderPos < sizeof(pchHeader))
+        return nCopy;
+
+    try {
+        CDataStream ssHeader(pchHeader, pchHeader + sizeof(pchHeader), vRecv.nType, vRecv.nVersion);
+        ssHeader >> hdr;
+    }
+    catch (std::exception &e) {
+        return -1;
+    }
+    if (!hdr.IsValid())
+        return -1;
+    fInData = true;
+    return nCopy;
+}
+
+int CNetMessage::ReadData(const char* pch, unsigned int nBytes)
+{
+    unsigned int nSpace;
+    char* pchSpace = GetDataSpace(nSpace);
+    unsigned int nCopy = min(nBytes, nSpace);
+    memcpy(pchSpace, pch, nCopy);
+    nDataPos += nCopy;
+    return nCopy;
+}
+
+char* CNode::GetRecvDataSpace(unsigned int& nSpace)
+{
+    nSpace = 0;
+    if (vRecvMsg.empty() || !vRecvMsg.back().fInData || vRecvMsg.back().IsComplete())
+        return NULL;
+    return vRecvMsg.back().GetDataSpace(nSpace);
+}
+
+void CNode::RecvDataInPlace(unsigned int nBytes)
+{
+    CNetMessage& msg = vRecvMsg.back();
+    msg.nDataPos += nBytes;
+    nRecvSize += nBytes;
+    if (msg.IsComplete())
+        nRecvMessages++;
+}
+
+bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
+{
+    while (nBytes > 0)
+    {
+        if (vRecvMsg.empty() || vRecvMsg.back().IsComplete())
+            vRecvMsg.push_back(CNetMessage(SER_NETWORK, nRecvVersion));
+
+        CNetMessage& msg = vRecvMsg.back();
+        int nUsed = (msg.fInData ? msg.ReadData(pch, nBytes) : msg.ReadHeader(pch, nBytes));
+        if (nUsed < 0)
+            return false;
+        pch += nUsed;
+        nBytes -= nUsed;
+        nRecvSize += nUsed;
+        if (msg.IsComplete())
+            nRecvMessages++;
+    }
+    return true;
+}
+
+void CNode::PopRecvMessages(std::deque<CNetMessage>::iterator itEnd)
+{
+    for (std::deque<CNetMessage>::iterator it = vRecvMsg.begin(); it != itEnd; ++it)
+    {
+        nRecvSize -= (*it).nHeaderPos + (*it).nDataPos;
+        if ((*it).IsComplete())
+            nRecvMessages--;
+    }
+    vRecvMsg.erase(vRecvMsg.begin(), itEnd);
+}
+
+CSendBuffer MakeSendBuffer(const char* pszCommand, const CDataStream& ssPayload)
+{
+    CMessageHeader hdr(pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(CMessageHeader::HEADER_SIZE + ssPayload.size());
+    ss << hdr << ssPayload;
+    boost::shared_ptr<CSerializeData> pbuf(new CSerializeData());
+    ss.GetAndClear(*pbuf);
+    return pbuf;
 }
 
 
@@ -623,6 +738,8 @@ void CNode::copyStats(CNodeStats &stats)
     X(nReleaseTime);
     X(nStartingHeight);
     X(nMisbehavior);
+    stats.nRecvBuffer = nRecvSize;
+    stats.nRecvMessages = nRecvMessages;
 }
 #undef X
 
@@ -635,6 +752,241 @@ void CNode::copyStats(CNodeStats &stats)
 
 
 
+//
+// Socket engine
+//
+// select() needs its fd_sets rebuilt from vNodes on every pass and can't
+// watch descriptors past FD_SETSIZE.  On Linux an edge-triggered epoll set
+// is used instead: each socket is registered once when its node is added,
+// and notifications are latched into CNode::fReadable/fWritable until a
+// recv or send reports that the socket would block.
+//
+
+static void InitSocketEngine()
+{
+#ifdef __linux__
+    if (hEpoll != -1 || !GetBoolArg("-epoll", true))
+        return;
+    hEpoll = epoll_create(1024);
+    if (hEpoll == -1)
+    {
+        printf("epoll_create failed (%d), using select()\n", errno);
+        return;
+    }
+
+    // Listening sockets stay level-triggered, they accept one per pass
+    BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket, &ev) != 0)
+            printf("epoll_ctl failed for listening socket (%d)\n", errno);
+    }
+    printf("Using epoll socket engine\n");
+#endif
+}
+
+static void SocketEngineAdd(CNode* pnode)
+{
+#ifdef __linux__
+    if (hEpoll == -1 || pnode->hSocket == INVALID_SOCKET)
+        return;
+
+    // A closed socket leaves the set by itself, but its number may be reused
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &ev) != 0 &&
+        (errno != EEXIST || epoll_ctl(hEpoll, EPOLL_CTL_MOD, pnode->hSocket, &ev) != 0))
+    {
+        printf("epoll_ctl failed for %s (%d)\n", pnode->addrName.c_str(), errno);
+        pnode->CloseSocketDisconnect();
+    }
+#endif
+}
+
+// Wait up to nTimeout milliseconds for socket activity and latch it into
+// the nodes' readiness flags.  fListenReady is set if a connection may be
+// waiting on one of the listening sockets.
+static void SocketEngineWait(int nTimeout, bool& fListenReady)
+{
+    fListenReady = false;
+
+#ifdef __linux__
+    if (hEpoll != -1)
+    {
+        struct epoll_event vEvents[256];
+        vnThreadsRunning[THREAD_SOCKETHANDLER]--;
+        int nEvents = epoll_wait(hEpoll, vEvents, 256, nTimeout);
+        vnThreadsRunning[THREAD_SOCKETHANDLER]++;
+        if (nEvents < 0)
+        {
+            if (errno != EINTR)
+            {
+                printf("socket epoll_wait error %d\n", errno);
+                Sleep(nTimeout);
+            }
+            return;
+        }
+        for (int i = 0; i < nEvents; i++)
+        {
+            // Nodes are only deleted by this thread, and close their socket
+            // (dropping any queued event) long before that
+            CNode* pnode = (CNode*)vEvents[i].data.ptr;
+            if (pnode == NULL)
+            {
+                fListenReady = true;
+                continue;
+            }
+            if (vEvents[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                pnode->fReadable = true;
+            if (vEvents[i].events & EPOLLOUT)
+                pnode->fWritable = true;
+        }
+        return;
+    }
+#endif
+
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = nTimeout * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket);
+    }
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetRecv);
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty())
+                    FD_SET(pnode->hSocket, &fdsetSend);
+            }
+        }
+    }
+
+    vnThreadsRunning[THREAD_SOCKETHANDLER]--;
+    int nSelect = select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    vnThreadsRunning[THREAD_SOCKETHANDLER]++;
+    if (fShutdown)
+        return;
+    if (nSelect == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (hSocketMax != INVALID_SOCKET)
+        {
+            printf("socket select error %d\n", nErr);
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        Sleep(timeout.tv_usec/1000);
+    }
+
+    // Readiness is only good for this pass
+    BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
+        if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
+            fListenReady = true;
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            SOCKET hSocket = pnode->hSocket;
+            pnode->fReadable = (hSocket != INVALID_SOCKET && (FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError)));
+            pnode->fWritable = (hSocket != INVALID_SOCKET && FD_ISSET(hSocket, &fdsetSend));
+        }
+    }
+}
+
+// Hand as much of the send queue to the socket as it takes, gathered
+// into one call.  Requires LOCK(pnode->cs_vSend).
+static void SocketSendData(CNode* pnode)
+{
+    while (!pnode->vSendMsg.empty())
+    {
+        unsigned int nOffset = pnode->nSendOffset;
+#ifdef WIN32
+        const CSerializeData& data = *pnode->vSendMsg.front();
+        unsigned int nRequested = data.size() - nOffset;
+        int nBytes = send(pnode->hSocket, &data[nOffset], nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        struct iovec iov[64];
+        int nIov = 0;
+        unsigned int nRequested = 0;
+        for (deque<CSendBuffer>::iterator it = pnode->vSendMsg.begin(); it != pnode->vSendMsg.end() && nIov < 64; ++it)
+        {
+            iov[nIov].iov_base = (void*)&(**it)[nOffset];
+            iov[nIov].iov_len = (**it).size() - nOffset;
+            nRequested += iov[nIov].iov_len;
+            nIov++;
+            nOffset = 0;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        int nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+        if (nBytes > 0)
+        {
+            pnode->nLastSend = GetTime();
+            pnode->nSendSize -= nBytes;
+
+            // Release the buffers that went out completely
+            unsigned int nSent = nBytes;
+            while (nSent > 0)
+            {
+                unsigned int nLeft = pnode->vSendMsg.front()->size() - pnode->nSendOffset;
+                if (nSent < nLeft)
+                {
+                    pnode->nSendOffset += nSent;
+                    break;
+                }
+                nSent -= nLeft;
+                pnode->vSendMsg.pop_front();
+                pnode->nSendOffset = 0;
+            }
+
+            // The socket buffer is full, wait for it to drain
+            if ((unsigned int)nBytes < nRequested)
+                break;
+        }
+        else
+        {
+            if (nBytes < 0)
+            {
+                // error
+                int nErr = WSAGetLastError();
+                if (nErr == WSAEWOULDBLOCK)
+                    pnode->fWritable = false;
+                else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                {
+                    printf("socket send error %d\n", nErr);
+                    pnode->CloseSocketDisconnect();
+                }
+            }
+            break;
+        }
+    }
+}
+
 void ThreadSocketHandler(void* parg)
 {
     IMPLEMENT_RANDOMIZE_STACK(ThreadSocketHandler(parg));
@@ -663,6 +1015,7 @@ void ThreadSocketHandler2(void* parg)
     printf("ThreadSocketHandler started\n");
     list<CNode*> vNodesDisconnected;
     unsigned int nPrevNodeCount = 0;
+    bool fMoreWork = false;
 
     loop
     {
@@ -676,7 +1029,7 @@ void ThreadSocketHandler2(void* parg)
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
             {
                 if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecv.empty() && pnode->vSend.empty()))
+                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->vSendMsg.empty()))
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
@@ -739,64 +1092,19 @@ void ThreadSocketHandler2(void* parg)
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-
-        BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket);
-        }
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetRecv);
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSend.empty())
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                }
-            }
-        }
-
-        vnThreadsRunning[THREAD_SOCKETHANDLER]--;
-        int nSelect = select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        vnThreadsRunning[THREAD_SOCKETHANDLER]++;
+        // Don't sleep while a socket still has data latched from last pass
+        bool fListenReady;
+        SocketEngineWait(fMoreWork ? 0 : 50, fListenReady); // 50ms: frequency to poll pnode->vSendMsg
         if (fShutdown)
             return;
-        if (nSelect == SOCKET_ERROR)
-        {
-            int nErr = WSAGetLastError();
-            if (hSocketMax != INVALID_SOCKET)
-            {
-                printf("socket select error %d\n", nErr);
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            Sleep(timeout.tv_usec/1000);
-        }
+        fMoreWork = false;
 
 
         //
         // Accept new connections
         //
         BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
-        if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
+        if (hListenSocket != INVALID_SOCKET && fListenReady)
         {
 #ifdef USE_IPV6
             struct sockaddr_storage sockaddr;
@@ -845,6 +1153,7 @@ void ThreadSocketHandler2(void* parg)
                 {
                     LOCK(cs_vNodes);
                     vNodes.push_back(pnode);
+                    SocketEngineAdd(pnode);
                 }
             }
         }
@@ -870,28 +1179,57 @@ void ThreadSocketHandler2(void* parg)
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (pnode->fReadable)
             {
                 TRY_LOCK(pnode->cs_vRecv, lockRecv);
                 if (lockRecv)
                 {
-                    CDataStream& vRecv = pnode->vRecv;
-                    unsigned int nPos = vRecv.size();
-
-                    if (nPos > ReceiveBufferSize()) {
+                    if (pnode->nRecvSize > ReceiveBufferSize()) {
                         if (!pnode->fDisconnect)
-                            printf("socket recv flood control disconnect (%d bytes)\n", vRecv.size());
+                            printf("socket recv flood control disconnect (%u bytes)\n", pnode->nRecvSize);
                         pnode->CloseSocketDisconnect();
                     }
                     else {
-                        // typical socket buffer is 8K-64K
+                        // typical socket buffer is 8K-64K.  The rest of a
+                        // payload that is under way goes straight into its
+                        // message, whatever follows is framed from pchBuf.
                         char pchBuf[0x10000];
+                        unsigned int nSpace;
+                        char* pchSpace = pnode->GetRecvDataSpace(nSpace);
+#ifdef WIN32
+                        pchSpace = NULL;
+                        nSpace = 0;
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+#else
+                        struct iovec iov[2];
+                        int nIov = 0;
+                        if (pchSpace)
+                        {
+                            iov[nIov].iov_base = pchSpace;
+                            iov[nIov].iov_len = nSpace;
+                            nIov++;
+                        }
+                        iov[nIov].iov_base = pchBuf;
+                        iov[nIov].iov_len = sizeof(pchBuf);
+                        nIov++;
+                        struct msghdr msg;
+                        memset(&msg, 0, sizeof(msg));
+                        msg.msg_iov = iov;
+                        msg.msg_iovlen = nIov;
+                        int nBytes = recvmsg(pnode->hSocket, &msg, MSG_DONTWAIT);
+#endif
                         if (nBytes > 0)
                         {
-                            vRecv.resize(nPos + nBytes);
-                            memcpy(&vRecv[nPos], pchBuf, nBytes);
+                            unsigned int nInPlace = (pchSpace ? min((unsigned int)nBytes, nSpace) : 0);
+                            if (nInPlace > 0)
+                                pnode->RecvDataInPlace(nInPlace);
+                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes - nInPlace))
+                            {
+                                printf("socket recv invalid message header\n");
+                                pnode->CloseSocketDisconnect();
+                            }
                             pnode->nLastRecv = GetTime();
+                            fMoreWork = true;
                         }
                         else if (nBytes == 0)
                         {
@@ -904,7 +1242,9 @@ void ThreadSocketHandler2(void* parg)
                         {
                             // error
                             int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                            if (nErr == WSAEWOULDBLOCK)
+                                pnode->fReadable = false;
+                            else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
                                     printf("socket recv error %d\n", nErr);
@@ -920,38 +1260,19 @@ void ThreadSocketHandler2(void* parg)
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fWritable)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                 {
-                    CDataStream& vSend = pnode->vSend;
-                    if (!vSend.empty())
-                    {
-                        int nBytes = send(pnode->hSocket, &vSend[0], vSend.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            vSend.erase(vSend.begin(), vSend.begin() + nBytes);
-                            pnode->nLastSend = GetTime();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                printf("socket send error %d\n", nErr);
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
+                    SocketSendData(pnode);
                 }
             }
 
             //
             // Inactivity checking
             //
-            if (pnode->vSend.empty())
+            if (pnode->vSendMsg.empty())
                 pnode->nLastSendEmpty = GetTime();
             if (GetTime() - pnode->nTimeConnected > 60)
             {
@@ -1530,8 +1851,16 @@ void ThreadMessageHandler(void* parg)
 
 void ThreadMessageHandler2(void* parg)
 {
-    printf("ThreadMessageHandler started\n");
+    // The first thread does all the sending. When there are others to
+    // handle whatever needs cs_main, it keeps to the messages that don't,
+    // so pings, addresses and getdata are answered during validation.
+    static int nThreadsStarted = 0;
+    bool fSender = (__sync_fetch_and_add(&nThreadsStarted, 1) == 0);
+    bool fMainLock = (!fSender || nMessageHandlerThreads == 1);
+
+    printf("ThreadMessageHandler started%s\n", fSender ? "" : " (validation)");
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    unsigned int nRound = 0;
     while (!fShutdown)
     {
         vector<CNode*> vNodesCopy;
@@ -1542,22 +1871,36 @@ void ThreadMessageHandler2(void* parg)
                 pnode->AddRef();
         }
 
-        // Poll the connected nodes for messages
+        // Invs relayed since the last pass go out as one batch
+        if (fSender)
+            GetRelayScheduler().Flush(vNodesCopy);
+
+        // Poll the connected nodes for messages, starting with a different
+        // one each time round so that none always goes first
+        bool fProgress = false;
         CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
+        if (fSender && !vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        for (unsigned int i = 0; i < vNodesCopy.size(); i++)
         {
+            CNode* pnode = vNodesCopy[(nRound + i) % vNodesCopy.size()];
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecv, lockRecv);
                 if (lockRecv)
-                    ProcessMessages(pnode);
+                {
+                    unsigned int nRecvMessages = pnode->nRecvMessages;
+                    ProcessMessages(pnode, fMainLock);
+                    if (pnode->nRecvMessages < nRecvMessages)
+                        fProgress = true;
+                }
             }
             if (fShutdown)
                 return;
 
             // Send messages
+            if (fSender)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
@@ -1566,6 +1909,7 @@ void ThreadMessageHandler2(void* parg)
             if (fShutdown)
                 return;
         }
+        nRound++;
 
         {
             LOCK(cs_vNodes);
@@ -1573,12 +1917,17 @@ void ThreadMessageHandler2(void* parg)
                 pnode->Release();
         }
 
+        // Messages are handled a few per peer at a time, so go round again
+        // straight away while there are more
+        if (fProgress)
+            continue;
+
         // Wait and allow messages to bunch up.
         // Reduce vnThreadsRunning so StopNode has permission to exit while
         // we're sleeping, but we must always check fShutdown after doing this.
         vnThreadsRunning[THREAD_MESSAGEHANDLER]--;
         Sleep(100);
-        if (fRequestShutdown)
+        if (fRequestShutdown && fSender)
             StartShutdown();
         vnThreadsRunning[THREAD_MESSAGEHANDLER]++;
         if (fShutdown)
@@ -1763,6 +2112,8 @@ void StartNode(void* parg)
         semOutbound = new CSemaphore(nMaxOutbound);
     }
 
+    InitSocketEngine();
+
     if (pnodeLocalHost == NULL)
         pnodeLocalHost = new CNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0), nLocalServices));
 
@@ -1803,8 +2154,10 @@ void StartNode(void* parg)
         printf("Error: CreateThread(ThreadOpenConnections) failed\n");
 
     // Process messages
-    if (!CreateThread(ThreadMessageHandler, NULL))
-        printf("Error: CreateThread(ThreadMessageHandler) failed\n");
+    nMessageHandlerThreads = max((int64)1, min(GetArg("-msgthreads", 2), (int64)16));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        if (!CreateThread(ThreadMessageHandler, NULL))
+            printf("Error: CreateThread(ThreadMessageHandler) failed\n");
 
     // Dump network addresses
     if (!CreateThread(ThreadDumpAddress, NULL))
@@ -1845,6 +2198,7 @@ bool StopNode()
     if (vnThreadsRunning[THREAD_DNSSEED] > 0) printf("ThreadDNSAddressSeed still running\n");
     if (vnThreadsRunning[THREAD_ADDEDCONNECTIONS] > 0) printf("ThreadOpenAddedConnections still running\n");
     if (vnThreadsRunning[THREAD_DUMPADDRESS] > 0) printf("ThreadDumpAddresses still running\n");
+    if (vnThreadsRunning[THREAD_SCRIPTCHECK] > 0) printf("ThreadScriptCheck still running\n");
     while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0)
         Sleep(20);
     Sleep(50);
@@ -9,6 +9,7 @@
 #include <deque>
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <openssl/rand.h>
 
 #ifndef WIN32
@@ -19,6 +20,7 @@
 #include "netbase.h"
 #include "protocol.h"
 #include "addrman.h"
+#include "relay.h"
 
 class CRequestTracker;
 class CNode;
@@ -40,6 +42,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *strDest = NULL, int64 nTime
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::string()));
+CSendBuffer MakeSendBuffer(const char* pszCommand, const CDataStream& ssPayload);
 void StartNode(void* parg);
 bool StopNode();
 
@@ -107,6 +110,7 @@ enum threadId
     THREAD_ADDEDCONNECTIONS,
     THREAD_DUMPADDRESS,
     THREAD_RPCHANDLER,
+    THREAD_SCRIPTCHECK,
 
     THREAD_MAX
 };
@@ -121,9 +125,6 @@ extern CAddrMan addrman;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64, CInv> > vRelayExpiration;
-extern CCriticalSection cs_mapRelay;
 extern std::map<CInv, int64> mapAlreadyAskedFor;
 
 
@@ -143,6 +144,48 @@ public:
     int64 nReleaseTime;
     int nStartingHeight;
     int nMisbehavior;
+    unsigned int nRecvBuffer;
+    unsigned int nRecvMessages;
+};
+
+
+
+
+/** A message as it arrives from a peer.  The header is parsed once it is
+ *  complete, and the payload is received straight into vRecv, which
+ *  ProcessMessage then reads from in place.
+ */
+class CNetMessage
+{
+public:
+    bool fInData;
+
+    char pchHeader[CMessageHeader::HEADER_SIZE];
+    unsigned int nHeaderPos;
+    CMessageHeader hdr;
+
+    CDataStream vRecv;
+    unsigned int nDataPos;
+
+    CNetMessage(int nTypeIn, int nVersionIn) : vRecv(nTypeIn, nVersionIn)
+    {
+        fInData = false;
+        nHeaderPos = 0;
+        nDataPos = 0;
+    }
+
+    bool IsComplete() const
+    {
+        return fInData && nDataPos == hdr.nMessageSize;
+    }
+
+    /** Space for the rest of the payload, grown a chunk at a time so a
+     *  header can't make us allocate its full claimed size up front */
+    char* GetDataSpace(unsigned int& nSpace);
+
+    /** Consume bytes; returns how many were used, or -1 if the header is bad */
+    int ReadHeader(const char* pch, unsigned int nBytes);
+    int ReadData(const char* pch, unsigned int nBytes);
 };
 
 
@@ -156,10 +199,16 @@ public:
     // socket
     uint64 nServices;
     SOCKET hSocket;
-    CDataStream vSend;
-    CDataStream vRecv;
+    CDataStream vSend;          // message being built
+    std::deque<CSendBuffer> vSendMsg;
+    unsigned int nSendOffset;   // bytes of vSendMsg.front() already sent
+    unsigned int nSendSize;     // bytes queued in vSendMsg, less nSendOffset
     CCriticalSection cs_vSend;
+    std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecv;
+    unsigned int nRecvSize;
+    unsigned int nRecvMessages;
+    int nRecvVersion;
     int64 nLastSend;
     int64 nLastRecv;
     int64 nLastSendEmpty;
@@ -173,10 +222,14 @@ public:
     std::string strSubVer;
     bool fOneShot;
     bool fClient;
+    bool fCompactBlocks; // negotiated in the version messages
     bool fInbound;
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    // Latched by the socket engine, cleared when the socket would block
+    bool fReadable;
+    bool fWritable;
     CSemaphoreGrant grantOutbound;
 protected:
     int nRefCount;
@@ -199,19 +252,27 @@ public:
     // flood relay
     std::vector<CAddress> vAddrToSend;
     std::set<CAddress> setAddrKnown;
+    CCriticalSection cs_vAddrToSend;
     bool fGetAddr;
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
+    uint64 nRelaySeq; // next relay batch to look at for invs sent at once
+    uint64 nTrickleSeq; // and for invs that wait for our trickle turn
     CCriticalSection cs_inventory;
     std::multimap<int64, CInv> mapAskFor;
 
-    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, MIN_PROTO_VERSION), vRecv(SER_NETWORK, MIN_PROTO_VERSION)
+    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, MIN_PROTO_VERSION), filterInventoryKnown(std::max(1000U, SendBufferSize() / 200), 0.000001)
     {
         nServices = 0;
         hSocket = hSocketIn;
+        nSendOffset = 0;
+        nSendSize = 0;
+        nRecvSize = 0;
+        nRecvMessages = 0;
+        nRecvVersion = MIN_PROTO_VERSION;
         nLastSend = 0;
         nLastRecv = 0;
         nLastSendEmpty = GetTime();
@@ -224,10 +285,13 @@ public:
         strSubVer = "";
         fOneShot = false;
         fClient = false; // set by version message
+        fCompactBlocks = false;
         fInbound = fInboundIn;
         fNetworkNode = false;
         fSuccessfullyConnected = false;
         fDisconnect = false;
+        fReadable = false;
+        fWritable = false;
         nRefCount = 0;
         nReleaseTime = 0;
         hashContinue = 0;
@@ -236,7 +300,8 @@ public:
         nStartingHeight = -1;
         fGetAddr = false;
         nMisbehavior = 0;
-        setInventoryKnown.max_size(SendBufferSize() / 1000);
+        nRelaySeq = 0;
+        nTrickleSeq = 0;
 
         // Be shy and don't send version until we hear
         if (!fInbound)
@@ -281,6 +346,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_vAddrToSend);
         setAddrKnown.insert(addr);
     }
 
@@ -289,6 +355,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_vAddrToSend);
         if (addr.IsValid() && !setAddrKnown.count(addr))
             vAddrToSend.push_back(addr);
     }
@@ -298,7 +365,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.Insert(inv.hash);
         }
     }
 
@@ -306,7 +373,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (!filterInventoryKnown.Contains(inv.hash))
                 vInventoryToSend.push_back(inv);
         }
     }
@@ -333,6 +400,21 @@ public:
 
 
 
+    // requires LOCK(cs_vRecv)
+    char* GetRecvDataSpace(unsigned int& nSpace);
+    void RecvDataInPlace(unsigned int nBytes);
+    bool ReceiveMsgBytes(const char* pch, unsigned int nBytes);
+    void PopRecvMessages(std::deque<CNetMessage>::iterator itEnd);
+
+    void SetRecvVersion(int nVersionIn)
+    {
+        nRecvVersion = nVersionIn;
+        BOOST_FOREACH(CNetMessage& msg, vRecvMsg)
+            msg.vRecv.SetVersion(nVersionIn);
+    }
+
+
+
     void BeginMessage(const char* pszCommand)
     {
         ENTER_CRITICAL_SECTION(cs_vSend);
@@ -385,6 +467,12 @@ public:
             printf("(%d bytes)\n", nSize);
         }
 
+        // Queue the finished message; vSend only ever holds the one being built
+        boost::shared_ptr<CSerializeData> pbuf(new CSerializeData());
+        vSend.GetAndClear(*pbuf);
+        nSendSize += pbuf->size();
+        vSendMsg.push_back(pbuf);
+
         nHeaderStart = -1;
         nMessageStart = -1;
         LEAVE_CRITICAL_SECTION(cs_vSend);
@@ -406,6 +494,16 @@ public:
     void PushVersion();
 
 
+    void PushSendBuffer(const CSendBuffer& buf)
+    {
+        LOCK(cs_vSend);
+        if (fDebug)
+            printf("sending: shared buffer (%u bytes)\n", (unsigned int)buf->size());
+        nSendSize += buf->size();
+        vSendMsg.push_back(buf);
+    }
+
+
     void PushMessage(const char* pszCommand)
     {
         try
@@ -648,43 +746,29 @@ public:
 
 
 
-inline void RelayInventory(const CInv& inv)
+inline void RelayInventory(const CInv& inv, bool fAlwaysTrickle=false)
 {
-    // Put on lists to offer to the other nodes
-    {
-        LOCK(cs_vNodes);
-        BOOST_FOREACH(CNode* pnode, vNodes)
-            pnode->PushInventory(inv);
-    }
+    // Queue to offer to the other nodes on the next pass
+    GetRelayScheduler().Push(inv, fAlwaysTrickle);
 }
 
 template<typename T>
-void RelayMessage(const CInv& inv, const T& a)
+void RelayMessage(const CInv& inv, const T& a, bool fAlwaysTrickle=false)
 {
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     ss.reserve(10000);
     ss << a;
-    RelayMessage(inv, ss);
+    RelayMessage(inv, ss, fAlwaysTrickle);
 }
 
 template<>
-inline void RelayMessage<>(const CInv& inv, const CDataStream& ss)
+inline void RelayMessage<>(const CInv& inv, const CDataStream& ss, bool fAlwaysTrickle)
 {
-    {
-        LOCK(cs_mapRelay);
-        // Expire old relay messages
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
-        {
-            mapRelay.erase(vRelayExpiration.front().second);
-            vRelayExpiration.pop_front();
-        }
-
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
-    }
+    // Save original serialized message so newer versions are preserved.
+    // It is framed once here and the buffer shared by every peer asking.
+    GetRelayPool().Insert(inv, MakeSendBuffer(inv.GetCommand(), ss), GetTime());
 
-    RelayInventory(inv);
+    RelayInventory(inv, fAlwaysTrickle);
 }
 
 
@@ -5,6 +5,7 @@
 #include "transactiontablemodel.h"
 
 #include "main.h"
+#include "hashmeter.h"
 #include "init.h" // for pwalletMain
 #include "ui_interface.h"
 
@@ -158,9 +159,17 @@ void ClientModel::setMiningPassword(QString password)
 
 int ClientModel::getHashrate() const
 {
-    if (GetTimeMillis() - nHPSTimerStart > 8000)
-        return (boost::int64_t)0;
-    return (boost::int64_t)dHashesPerSec;
+    return (boost::int64_t)GetHashesPerSec(HASHMETER_WINDOW_60S);
+}
+
+QList<double> ClientModel::getThreadHashrates() const
+{
+    std::vector<double> vThreadRates;
+    GetHashesPerSec(HASHMETER_WINDOW_60S, &vThreadRates);
+    QList<double> rates;
+    for (unsigned int i = 0; i < vThreadRates.size(); i++)
+        rates.append(vThreadRates[i]);
+    return rates;
 }
 
 // Litecoin: copied from bitcoinrpc.cpp.
@@ -2,6 +2,7 @@
 #define CLIENTMODEL_H
 
 #include <QObject>
+#include <QList>
 
 class OptionsModel;
 class AddressTableModel;
@@ -50,6 +51,8 @@ public:
     void setMiningPassword(QString password);
 
     int getHashrate() const;
+    //! Return the hash rate of each solo mining thread over the last minute
+    QList<double> getThreadHashrates() const;
     double GetDifficulty() const;
 
     QDateTime getLastBlockDate() const;
@@ -51,6 +51,8 @@ void MiningPage::setModel(ClientModel *model)
     bool pool = model->getMiningType() == ClientModel::PoolMining;
     ui->threadsBox->setValue(model->getMiningThreads());
     ui->typeBox->setCurrentIndex(pool ? 1 : 0);
+
+    connect(model, SIGNAL(miningChanged(bool,int)), this, SLOT(updateSoloSpeed()));
 //    if (model->getMiningStarted())
 //        startPressed();
 }
@@ -278,6 +280,26 @@ void MiningPage::updateSpeed()
     model->setMining(getMiningType(), true, initThreads, totalSpeed*1000);
 }
 
+void MiningPage::updateSoloSpeed()
+{
+    if (!minerActive || getMiningType() != ClientModel::SoloMining)
+        return;
+
+    // Solo mining threads report through the same hash meters as getmininginfo
+    threadSpeed.clear();
+    QList<double> rates = model->getThreadHashrates();
+    double totalSpeed = 0;
+    for (int i = 0; i < rates.size(); i++)
+    {
+        threadSpeed[i] = rates[i] / 1000.0;
+        totalSpeed += threadSpeed[i];
+    }
+
+    QString speedString = QString("%1").arg(totalSpeed);
+    QString threadsString = QString("%1").arg(rates.size());
+    ui->mineSpeedLabel->setText(QString("Speed: %1 khash/sec - %2 thread(s)").arg(speedString, threadsString));
+}
+
 void MiningPage::reportToList(QString msg, int type, QString time)
 {
     QString message;
@@ -59,6 +59,7 @@ public slots:
     void stopPoolMining();
 
     void updateSpeed();
+    void updateSoloSpeed();
 
     void loadSettings();
     void saveSettings();
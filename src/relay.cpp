@@ -0,0 +1,309 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <math.h>
+
+#include "relay.h"
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+// Finalizer of MurmurHash3, every input bit affects every output bit
+static inline uint64 Mix64(uint64 k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Txids are already hashes, so mixing in a secret salt is enough to stop
+// an outsider picking ones that land together
+static inline uint64 SaltedHash(const uint256& hash, const uint256& salt, int n)
+{
+    return Mix64(hash.Get64(n) ^ salt.Get64(n)) ^ Mix64(hash.Get64(n + 1) ^ salt.Get64(n + 1) ^ Mix64(n));
+}
+
+
+CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double nFPRate)
+{
+    salt = GetRandHash();
+
+    // Sized as a plain bloom filter holding all three generations at once
+    double dLogFPRate = log(nFPRate);
+    nHashFuncs = max(1, min((int)(dLogFPRate / log(0.5) + 0.5), 50));
+    nEntriesPerGeneration = max(1U, (nElements + 1) / 2);
+    unsigned int nMaxElements = nEntriesPerGeneration * 3;
+    unsigned int nFilterBits = (unsigned int)ceil(-1.0 * nHashFuncs * nMaxElements / log(1.0 - exp(dLogFPRate / nHashFuncs)));
+    vData.resize(((nFilterBits + 63) / 64) * 2);
+
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+}
+
+void CRollingBloomFilter::GetHashes(const uint256& hash, uint64& h1, uint64& h2) const
+{
+    h1 = SaltedHash(hash, salt, 0);
+    h2 = SaltedHash(hash, salt, 2) | 1;
+}
+
+void CRollingBloomFilter::Insert(const uint256& hash)
+{
+    if (nEntriesThisGeneration == nEntriesPerGeneration)
+    {
+        nEntriesThisGeneration = 0;
+        nGeneration++;
+        if (nGeneration == 4)
+            nGeneration = 1;
+
+        // Wipe the positions last set by the generation being reused
+        uint64 nMask1 = 0 - (uint64)(nGeneration & 1);
+        uint64 nMask2 = 0 - (uint64)(nGeneration >> 1);
+        for (unsigned int p = 0; p < vData.size(); p += 2)
+        {
+            uint64 p1 = vData[p], p2 = vData[p + 1];
+            uint64 nMask = (p1 ^ nMask1) | (p2 ^ nMask2);
+            vData[p] = p1 & nMask;
+            vData[p + 1] = p2 & nMask;
+        }
+    }
+    nEntriesThisGeneration++;
+
+    uint64 h1, h2;
+    GetHashes(hash, h1, h2);
+    unsigned int nPairs = vData.size() / 2;
+    for (unsigned int i = 0; i < nHashFuncs; i++)
+    {
+        uint64 h = h1 + i * h2;
+        int nBit = h & 63;
+        unsigned int nPos = ((h >> 32) * nPairs >> 32) * 2;
+        vData[nPos] = (vData[nPos] & ~(1ULL << nBit)) | (uint64)(nGeneration & 1) << nBit;
+        vData[nPos + 1] = (vData[nPos + 1] & ~(1ULL << nBit)) | (uint64)(nGeneration >> 1) << nBit;
+    }
+}
+
+bool CRollingBloomFilter::Contains(const uint256& hash) const
+{
+    uint64 h1, h2;
+    GetHashes(hash, h1, h2);
+    unsigned int nPairs = vData.size() / 2;
+    for (unsigned int i = 0; i < nHashFuncs; i++)
+    {
+        uint64 h = h1 + i * h2;
+        int nBit = h & 63;
+        unsigned int nPos = ((h >> 32) * nPairs >> 32) * 2;
+        // Generation 0 is an empty position
+        if (!(((vData[nPos] | vData[nPos + 1]) >> nBit) & 1))
+            return false;
+    }
+    return true;
+}
+
+void CRollingBloomFilter::Clear()
+{
+    fill(vData.begin(), vData.end(), 0);
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+}
+
+
+CRelayScheduler::CRelayScheduler(unsigned int nMaxLagIn)
+{
+    nMaxLag = max(2U, nMaxLagIn);
+    salt = GetRandHash();
+    nNextSeq = 1;
+    nRelayed = 0;
+    nAnnounced = 0;
+    nFiltered = 0;
+}
+
+void CRelayScheduler::Push(const CInv& inv, bool fAlwaysTrickle)
+{
+    // Trickle out tx inv to protect privacy, 1/4 of them blast to all
+    // immediately.  Always trickle our own transactions.
+    bool fTrickle = (inv.type == MSG_TX && (fAlwaysTrickle || (SaltedHash(inv.hash, salt, 0) & 3) != 0));
+
+    LOCK(cs);
+    vPending.push_back(make_pair(inv, fTrickle));
+    nRelayed++;
+}
+
+void CRelayScheduler::Flush(const vector<CNode*>& vNodes)
+{
+    // Oldest batch some node is still waiting on; a node that hasn't
+    // asked yet starts at the next batch
+    uint64 nMinSeq = 0;
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        LOCK(pnode->cs_inventory);
+        if (pnode->nTrickleSeq != 0 && (nMinSeq == 0 || pnode->nTrickleSeq < nMinSeq))
+            nMinSeq = pnode->nTrickleSeq;
+    }
+
+    LOCK(cs);
+    if (nMinSeq == 0)
+        nMinSeq = nNextSeq;
+    while (!vBatch.empty() && (vBatch.front()->nSeq < nMinSeq || vBatch.size() >= nMaxLag))
+        vBatch.pop_front();
+
+    if (!vPending.empty())
+    {
+        CBatch* pbatch = new CBatch();
+        pbatch->nSeq = nNextSeq++;
+        pbatch->vInv.swap(vPending);
+        vBatch.push_back(CBatchRef(pbatch));
+    }
+}
+
+void CRelayScheduler::GetInventory(CNode* pnode, bool fSendTrickle, vector<CInv>& vInv)
+{
+    LOCK(pnode->cs_inventory);
+
+    // Take references to the batches under the lock, and read them without
+    vector<CBatchRef> vTake;
+    uint64 nRelaySeq;
+    {
+        LOCK(cs);
+        if (pnode->nRelaySeq == 0)
+            pnode->nRelaySeq = pnode->nTrickleSeq = nNextSeq;
+        if (nNextSeq - pnode->nTrickleSeq > nMaxLag / 2)
+            fSendTrickle = true;
+
+        nRelaySeq = pnode->nRelaySeq;
+        uint64 nFromSeq = fSendTrickle ? pnode->nTrickleSeq : nRelaySeq;
+        if (!vBatch.empty())
+        {
+            uint64 nFirst = vBatch.front()->nSeq;
+            for (unsigned int i = (nFromSeq > nFirst ? nFromSeq - nFirst : 0); i < vBatch.size(); i++)
+                vTake.push_back(vBatch[i]);
+        }
+
+        pnode->nRelaySeq = nNextSeq;
+        if (fSendTrickle)
+            pnode->nTrickleSeq = nNextSeq;
+    }
+
+    int64 nSent = 0, nKnown = 0;
+    BOOST_FOREACH(const CBatchRef& batch, vTake)
+    {
+        // Earlier batches were only gone through for what trickles
+        bool fNew = (batch->nSeq >= nRelaySeq);
+        for (vector<pair<CInv, bool> >::const_iterator it = batch->vInv.begin(); it != batch->vInv.end(); ++it)
+        {
+            bool fTrickle = (*it).second;
+            if (fTrickle ? !fSendTrickle : !fNew)
+                continue;
+            const CInv& inv = (*it).first;
+            if (pnode->filterInventoryKnown.Contains(inv.hash))
+            {
+                nKnown++;
+                continue;
+            }
+            pnode->filterInventoryKnown.Insert(inv.hash);
+            vInv.push_back(inv);
+            nSent++;
+        }
+    }
+    __sync_fetch_and_add(&nAnnounced, nSent);
+    __sync_fetch_and_add(&nFiltered, nKnown);
+}
+
+unsigned int CRelayScheduler::GetBatches()
+{
+    LOCK(cs);
+    return vBatch.size();
+}
+
+CRelayScheduler& GetRelayScheduler()
+{
+    // A pass of the message handlers takes at least 100ms when idle
+    static CRelayScheduler relayScheduler(1200);
+    return relayScheduler;
+}
+
+
+CRelayPool::CRelayPool(uint64 nMaxBytesIn, int64 nExpiryIn)
+{
+    nMaxBytes = nMaxBytesIn;
+    nExpiry = nExpiryIn;
+    nBytes = 0;
+    nHits = 0;
+    nMisses = 0;
+    nExpired = 0;
+    nEvictions = 0;
+}
+
+void CRelayPool::EraseOldest()
+{
+    MapType::iterator mi = vQueue.front();
+    nBytes -= (*mi).second.first->size();
+    mapRelay.erase(mi);
+    vQueue.pop_front();
+}
+
+void CRelayPool::Insert(const CInv& inv, const CSendBuffer& buf, int64 nNow)
+{
+    LOCK(cs);
+    while (!vQueue.empty() && vQueue.front()->second.second < nNow)
+    {
+        EraseOldest();
+        nExpired++;
+    }
+
+    if (!buf || buf->size() > nMaxBytes || mapRelay.count(inv))
+        return;
+    while (nBytes + buf->size() > nMaxBytes)
+    {
+        EraseOldest();
+        nEvictions++;
+    }
+
+    vQueue.push_back(mapRelay.insert(make_pair(inv, make_pair(buf, nNow + nExpiry))).first);
+    nBytes += buf->size();
+}
+
+bool CRelayPool::Get(const CInv& inv, CSendBuffer& buf)
+{
+    LOCK(cs);
+    MapType::iterator mi = mapRelay.find(inv);
+    if (mi == mapRelay.end())
+    {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    buf = (*mi).second.first;
+    return true;
+}
+
+void CRelayPool::Expire(int64 nNow)
+{
+    LOCK(cs);
+    while (!vQueue.empty() && vQueue.front()->second.second < nNow)
+    {
+        EraseOldest();
+        nExpired++;
+    }
+}
+
+unsigned int CRelayPool::GetCount()
+{
+    LOCK(cs);
+    return mapRelay.size();
+}
+
+uint64 CRelayPool::GetSize()
+{
+    LOCK(cs);
+    return nBytes;
+}
+
+CRelayPool& GetRelayPool()
+{
+    static CRelayPool relayPool(max((int64)0, min(GetArg("-relaypoolsize", 32), (int64)4096)) << 20, 15 * 60);
+    return relayPool;
+}
@@ -0,0 +1,173 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_RELAY_H
+#define BITCOIN_RELAY_H
+
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "protocol.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+class CNode;
+
+/** A whole serialized message, header included.  Never modified once built,
+ *  so the same buffer can be queued to every peer it goes to. */
+typedef boost::shared_ptr<const CSerializeData> CSendBuffer;
+
+/** Hashes seen recently, kept in a fixed amount of memory.
+ *
+ * A bloom filter whose entries are inserted in three generations of
+ * nElements / 2 each.  Every position carries the two bit generation
+ * number of the last entry that set it, and starting a new generation
+ * clears the positions of the oldest one, so the filter always holds at
+ * least the last nElements hashes and at most half as many again.
+ * Positions are salted per filter, so a hash that collides for one peer
+ * does not for the others.
+ */
+class CRollingBloomFilter
+{
+public:
+    CRollingBloomFilter(unsigned int nElements, double nFPRate);
+
+    void Insert(const uint256& hash);
+    bool Contains(const uint256& hash) const;
+    void Clear();
+
+    unsigned int GetMemoryUsage() const { return vData.size() * sizeof(uint64); }
+
+private:
+    void GetHashes(const uint256& hash, uint64& h1, uint64& h2) const;
+
+    uint256 salt;
+    unsigned int nHashFuncs;
+    unsigned int nEntriesPerGeneration;
+    unsigned int nEntriesThisGeneration;
+    int nGeneration;
+    // Pairs of words: bit n of the pair holds the generation of position n
+    std::vector<uint64> vData;
+};
+
+/** Transaction inventory waiting to be announced to every peer.
+ *
+ * Relaying used to put each inv on the list of every connected node.
+ * Now it is appended once to a pending list, and once per message
+ * handler pass Flush() seals whatever has come in into a numbered batch
+ * shared by all peers.  SendMessages takes the batches a peer has not
+ * seen yet, so a relay costs one filter lookup per peer and no locking
+ * of vNodes.
+ *
+ * Whether a tx inv trickles is decided once, when it is queued: a salted
+ * quarter of them go to every peer straight away, the rest and our own
+ * transactions only to the peer whose trickle turn it is.  Each peer
+ * keeps a cursor for each kind.  A peer that has gone nMaxLag / 2
+ * batches without a trickle turn gets one, and no more than nMaxLag
+ * batches are kept.
+ */
+class CRelayScheduler
+{
+public:
+    CRelayScheduler(unsigned int nMaxLag);
+
+    /** Queue inv to go to every peer */
+    void Push(const CInv& inv, bool fAlwaysTrickle = false);
+
+    /** Seal the pending invs into a batch, and drop the batches every
+     *  node in vNodes has had */
+    void Flush(const std::vector<CNode*>& vNodes);
+
+    /** Add to vInv what pnode hasn't been sent or told about yet */
+    void GetInventory(CNode* pnode, bool fSendTrickle, std::vector<CInv>& vInv);
+
+    /** Number of batches held */
+    unsigned int GetBatches();
+
+    // Counters since startup
+    int64 GetRelayed() const { return nRelayed; }
+    int64 GetAnnounced() const { return nAnnounced; }
+    int64 GetFiltered() const { return nFiltered; }
+
+private:
+    struct CBatch
+    {
+        uint64 nSeq;
+        // Each inv and whether it trickles
+        std::vector<std::pair<CInv, bool> > vInv;
+    };
+    typedef boost::shared_ptr<const CBatch> CBatchRef;
+
+    CCriticalSection cs;
+    unsigned int nMaxLag;
+    uint256 salt;
+    uint64 nNextSeq;
+    std::vector<std::pair<CInv, bool> > vPending;
+    std::deque<CBatchRef> vBatch;
+
+    volatile int64 nRelayed;
+    volatile int64 nAnnounced;
+    volatile int64 nFiltered;
+};
+
+/** The scheduler used by RelayInventory */
+CRelayScheduler& GetRelayScheduler();
+
+/** Messages relayed recently, kept to answer getdata.
+ *
+ * Each tx is framed once when it is relayed and the buffer is shared by
+ * every peer that asks for it.  Entries expire nExpiry seconds after they
+ * were added, so the order they were added in is also the order they go
+ * in: a queue of map iterators gives the oldest one without searching,
+ * whether it goes for its age or to keep the total under nMaxBytes.
+ */
+class CRelayPool
+{
+public:
+    /** Keep up to nMaxBytes of messages for nExpiry seconds each */
+    CRelayPool(uint64 nMaxBytes, int64 nExpiry);
+
+    /** Hold buf for inv; does nothing if inv is already held */
+    void Insert(const CInv& inv, const CSendBuffer& buf, int64 nNow);
+    bool Get(const CInv& inv, CSendBuffer& buf);
+    /** Drop what was added more than nExpiry seconds before nNow */
+    void Expire(int64 nNow);
+
+    /** Number of messages held */
+    unsigned int GetCount();
+    /** Bytes held */
+    uint64 GetSize();
+    uint64 GetMaxSize() const { return nMaxBytes; }
+
+    // Counters since startup
+    int64 GetHits() const { return nHits; }
+    int64 GetMisses() const { return nMisses; }
+    int64 GetExpired() const { return nExpired; }
+    int64 GetEvictions() const { return nEvictions; }
+
+private:
+    typedef std::map<CInv, std::pair<CSendBuffer, int64> > MapType;
+
+    void EraseOldest();
+
+    CCriticalSection cs;
+    uint64 nMaxBytes;
+    int64 nExpiry;
+    uint64 nBytes;
+    MapType mapRelay; // buffer and expiry time
+    std::deque<MapType::iterator> vQueue; // oldest first
+
+    int64 nHits;
+    int64 nMisses;
+    int64 nExpired;
+    int64 nEvictions;
+};
+
+/** The pool used by RelayMessage, sized by -relaypoolsize on first use */
+CRelayPool& GetRelayPool();
+
+#endif
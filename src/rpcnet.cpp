@@ -59,6 +59,8 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("releasetime", (boost::int64_t)stats.nReleaseTime));
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         obj.push_back(Pair("banscore", stats.nMisbehavior));
+        obj.push_back(Pair("recvbuffer", (boost::int64_t)stats.nRecvBuffer));
+        obj.push_back(Pair("recvmessages", (boost::int64_t)stats.nRecvMessages));
 
         ret.push_back(obj);
     }
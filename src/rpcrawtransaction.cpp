@@ -25,6 +25,8 @@ extern int64 AmountFromValue(const Value& value);
 extern Value ValueFromAmount(int64 amount);
 extern std::string HelpRequiringPassphrase();
 extern void EnsureWalletIsUnlocked();
+extern int ParsePageCount(const Value& value);
+extern vector<uint256> ParseCursor(const Value& value, unsigned int nHashes);
 
 void
 ScriptPubKeyToJSON(const CScript& scriptPubKey, Object& out)
@@ -145,16 +147,19 @@ Value getrawtransaction(const Array& params, bool fHelp)
 
 Value listunspent(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() > 3)
+    if (fHelp || params.size() > 5)
         throw runtime_error(
-            "listunspent [minconf=1] [maxconf=9999999]  [\"address\",...]\n"
+            "listunspent [minconf=1] [maxconf=9999999]  [\"address\",...] [count] [cursor]\n"
             "Returns array of unspent transaction outputs\n"
             "with between minconf and maxconf (inclusive) confirmations.\n"
             "Optionally filtered to only include txouts paid to specified addresses.\n"
             "Results are an array of Objects, each of which has:\n"
-            "{txid, vout, scriptPubKey, amount, confirmations}");
+            "{txid, vout, scriptPubKey, amount, confirmations}\n"
+            "With [count], looks at the outputs of that many transactions (at most 10000) from\n"
+            "after [cursor] and returns {\"unspent\":[...],\"cursor\":...}; pass the cursor back\n"
+            "for the next page, until there is none.");
 
-    RPCTypeCheck(params, list_of(int_type)(int_type)(array_type));
+    RPCTypeCheck(params, list_of(int_type)(int_type)(array_type)(int_type)(str_type));
 
     int nMinDepth = 1;
     if (params.size() > 0)
@@ -179,9 +184,18 @@ Value listunspent(const Array& params, bool fHelp)
         }
     }
 
+    int nCount = 0;
+    if (params.size() > 3)
+        nCount = ParsePageCount(params[3]);
+
+    vector<uint256> vCursor;
+    if (params.size() > 4)
+        vCursor = ParseCursor(params[4], 1);
+
     Array results;
     vector<COutput> vecOutputs;
-    pwalletMain->AvailableCoins(vecOutputs, false);
+    uint256 hashLast;
+    bool fMore = pwalletMain->AvailableCoins(vecOutputs, false, vCursor.empty() ? NULL : &vCursor[0], nCount, hashLast);
     BOOST_FOREACH(const COutput& out, vecOutputs)
     {
         if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
@@ -226,7 +240,14 @@ Value listunspent(const Array& params, bool fHelp)
         results.push_back(entry);
     }
 
-    return results;
+    if (nCount == 0)
+        return results;
+
+    Object ret;
+    ret.push_back(Pair("unspent", results));
+    if (fMore)
+        ret.push_back(Pair("cursor", hashLast.GetHex()));
+    return ret;
 }
 
 Value createrawtransaction(const Array& params, bool fHelp)
@@ -33,6 +33,12 @@
 #include <string.h>
 #include <openssl/sha.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCRYPT_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
 static inline uint32_t be32dec(const void *pp)
 {
 	const uint8_t *p = (uint8_t const *)pp;
@@ -134,13 +140,45 @@ HMAC_SHA256_Final(unsigned char digest[32], HMAC_SHA256_CTX *ctx)
 	memset(ihash, 0, 32);
 }
 
+/*
+ * Key an HMAC-SHA256 operation with an 80-byte block header.  The header is
+ * longer than the SHA256 block size, so HMAC keys with SHA256(header).  If
+ * midstate is given it must be the SHA256 state after the first 64 header
+ * bytes (as built by FormatHashBuffers), and only the last block is hashed.
+ */
+static void
+HMAC_SHA256_Init_header(HMAC_SHA256_CTX *ctx, const uint8_t *header,
+    const uint32_t *midstate)
+{
+	SHA256_CTX sctx;
+	unsigned char khash[32];
+	int i;
+
+	SHA256_Init(&sctx);
+	if (midstate) {
+		for (i = 0; i < 8; i++)
+			sctx.h[i] = midstate[i];
+		sctx.Nl = 64 * 8;
+		SHA256_Update(&sctx, header + 64, 16);
+	} else
+		SHA256_Update(&sctx, header, 80);
+	SHA256_Final(khash, &sctx);
+
+	HMAC_SHA256_Init(ctx, khash, 32);
+
+	/* Clean the stack. */
+	memset(khash, 0, 32);
+}
+
 /**
- * PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, c, buf, dkLen):
+ * PBKDF2_SHA256(keyctx, salt, saltlen, c, buf, dkLen):
  * Compute PBKDF2(passwd, salt, c, dkLen) using HMAC-SHA256 as the PRF, and
- * write the output to buf.  The value dkLen must be at most 32 * (2^32 - 1).
+ * write the output to buf.  keyctx is an HMAC state freshly keyed with
+ * passwd, so the key setup can be shared between calls with the same
+ * passwd.  The value dkLen must be at most 32 * (2^32 - 1).
  */
 static void
-PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
+PBKDF2_SHA256(const HMAC_SHA256_CTX *keyctx, const uint8_t *salt,
     size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen)
 {
 	HMAC_SHA256_CTX PShctx, hctx;
@@ -153,7 +191,7 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 	size_t clen;
 
 	/* Compute HMAC state after processing P and S. */
-	HMAC_SHA256_Init(&PShctx, passwd, passwdlen);
+	memcpy(&PShctx, keyctx, sizeof(HMAC_SHA256_CTX));
 	HMAC_SHA256_Update(&PShctx, salt, saltlen);
 
 	/* Iterate through the blocks. */
@@ -171,7 +209,7 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 
 		for (j = 2; j <= c; j++) {
 			/* Compute U_j. */
-			HMAC_SHA256_Init(&hctx, passwd, passwdlen);
+			memcpy(&hctx, keyctx, sizeof(HMAC_SHA256_CTX));
 			HMAC_SHA256_Update(&hctx, U, 32);
 			HMAC_SHA256_Final(U, &hctx);
 
@@ -260,16 +298,18 @@ static inline void xor_salsa8(uint32_t B[16], const uint32_t Bx[16])
 	B[15] += x15;
 }
 
-void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad)
+static void scrypt_1024_1_1_256_sp_1way(const char *input, char *output, char *scratchpad, const uint32_t *midstate)
 {
+	HMAC_SHA256_CTX keyctx;
 	uint8_t B[128];
 	uint32_t X[32];
 	uint32_t *V;
 	uint32_t i, j, k;
 
 	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
-	
-	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
+
+	HMAC_SHA256_Init_header(&keyctx, (const uint8_t *)input, midstate);
+	PBKDF2_SHA256(&keyctx, (const uint8_t *)input, 80, 1, B, 128);
 
 	for (k = 0; k < 32; k++)
 		X[k] = le32dec(&B[4 * k]);
@@ -290,7 +330,199 @@ void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad)
 	for (k = 0; k < 32; k++)
 		le32enc(&B[4 * k], X[k]);
 
-	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
+	PBKDF2_SHA256(&keyctx, B, 128, 1, (uint8_t *)output, 32);
+}
+
+void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad)
+{
+	scrypt_1024_1_1_256_sp_1way(input, output, scratchpad, NULL);
+}
+
+#ifdef SCRYPT_X86
+
+/*
+ * Multi-lane scrypt.  Each SIMD register holds the same 32-bit word of
+ * 4 (SSE2) or 8 (AVX2) independent scrypt states, so the Salsa20/8 rounds
+ * for all lanes run as plain vertical vector ops.  Only the data-dependent
+ * lookups into V have to be done per lane.
+ */
+#define SALSA8_DOUBLEROUNDS(ADD, XOR, ROTL) \
+	for (i = 0; i < 8; i += 2) { \
+		x04 = XOR(x04, ROTL(ADD(x00, x12),  7)); x09 = XOR(x09, ROTL(ADD(x05, x01),  7)); \
+		x14 = XOR(x14, ROTL(ADD(x10, x06),  7)); x03 = XOR(x03, ROTL(ADD(x15, x11),  7)); \
+		x08 = XOR(x08, ROTL(ADD(x04, x00),  9)); x13 = XOR(x13, ROTL(ADD(x09, x05),  9)); \
+		x02 = XOR(x02, ROTL(ADD(x14, x10),  9)); x07 = XOR(x07, ROTL(ADD(x03, x15),  9)); \
+		x12 = XOR(x12, ROTL(ADD(x08, x04), 13)); x01 = XOR(x01, ROTL(ADD(x13, x09), 13)); \
+		x06 = XOR(x06, ROTL(ADD(x02, x14), 13)); x11 = XOR(x11, ROTL(ADD(x07, x03), 13)); \
+		x00 = XOR(x00, ROTL(ADD(x12, x08), 18)); x05 = XOR(x05, ROTL(ADD(x01, x13), 18)); \
+		x10 = XOR(x10, ROTL(ADD(x06, x02), 18)); x15 = XOR(x15, ROTL(ADD(x11, x07), 18)); \
+		x01 = XOR(x01, ROTL(ADD(x00, x03),  7)); x06 = XOR(x06, ROTL(ADD(x05, x04),  7)); \
+		x11 = XOR(x11, ROTL(ADD(x10, x09),  7)); x12 = XOR(x12, ROTL(ADD(x15, x14),  7)); \
+		x02 = XOR(x02, ROTL(ADD(x01, x00),  9)); x07 = XOR(x07, ROTL(ADD(x06, x05),  9)); \
+		x08 = XOR(x08, ROTL(ADD(x11, x10),  9)); x13 = XOR(x13, ROTL(ADD(x12, x15),  9)); \
+		x03 = XOR(x03, ROTL(ADD(x02, x01), 13)); x04 = XOR(x04, ROTL(ADD(x07, x06), 13)); \
+		x09 = XOR(x09, ROTL(ADD(x08, x11), 13)); x14 = XOR(x14, ROTL(ADD(x13, x12), 13)); \
+		x00 = XOR(x00, ROTL(ADD(x03, x02), 18)); x05 = XOR(x05, ROTL(ADD(x04, x07), 18)); \
+		x10 = XOR(x10, ROTL(ADD(x09, x08), 18)); x15 = XOR(x15, ROTL(ADD(x14, x13), 18)); \
+	}
+
+#define XOR_SALSA8_LANES(T, ADD, XOR, ROTL) \
+	T x00,x01,x02,x03,x04,x05,x06,x07,x08,x09,x10,x11,x12,x13,x14,x15; \
+	int i; \
+	x00 = (B[ 0] = XOR(B[ 0], Bx[ 0])); x01 = (B[ 1] = XOR(B[ 1], Bx[ 1])); \
+	x02 = (B[ 2] = XOR(B[ 2], Bx[ 2])); x03 = (B[ 3] = XOR(B[ 3], Bx[ 3])); \
+	x04 = (B[ 4] = XOR(B[ 4], Bx[ 4])); x05 = (B[ 5] = XOR(B[ 5], Bx[ 5])); \
+	x06 = (B[ 6] = XOR(B[ 6], Bx[ 6])); x07 = (B[ 7] = XOR(B[ 7], Bx[ 7])); \
+	x08 = (B[ 8] = XOR(B[ 8], Bx[ 8])); x09 = (B[ 9] = XOR(B[ 9], Bx[ 9])); \
+	x10 = (B[10] = XOR(B[10], Bx[10])); x11 = (B[11] = XOR(B[11], Bx[11])); \
+	x12 = (B[12] = XOR(B[12], Bx[12])); x13 = (B[13] = XOR(B[13], Bx[13])); \
+	x14 = (B[14] = XOR(B[14], Bx[14])); x15 = (B[15] = XOR(B[15], Bx[15])); \
+	SALSA8_DOUBLEROUNDS(ADD, XOR, ROTL) \
+	B[ 0] = ADD(B[ 0], x00); B[ 1] = ADD(B[ 1], x01); \
+	B[ 2] = ADD(B[ 2], x02); B[ 3] = ADD(B[ 3], x03); \
+	B[ 4] = ADD(B[ 4], x04); B[ 5] = ADD(B[ 5], x05); \
+	B[ 6] = ADD(B[ 6], x06); B[ 7] = ADD(B[ 7], x07); \
+	B[ 8] = ADD(B[ 8], x08); B[ 9] = ADD(B[ 9], x09); \
+	B[10] = ADD(B[10], x10); B[11] = ADD(B[11], x11); \
+	B[12] = ADD(B[12], x12); B[13] = ADD(B[13], x13); \
+	B[14] = ADD(B[14], x14); B[15] = ADD(B[15], x15);
+
+/*
+ * Body shared by the 4-way and 8-way kernels.  Expects LANES, a vector
+ * type T, a salsa function SALSA and the union type of X to be in scope.
+ */
+#define SCRYPT_LANES_BODY(LANES, SALSA) \
+	for (l = 0; l < LANES; l++) { \
+		HMAC_SHA256_Init_header(&keyctx[l], \
+		    (const uint8_t *)&input[80 * l], midstate); \
+		PBKDF2_SHA256(&keyctx[l], (const uint8_t *)&input[80 * l], 80, \
+		    1, B[l], 128); \
+		for (k = 0; k < 32; k++) \
+			X.w[k][l] = le32dec(&B[l][4 * k]); \
+	} \
+	for (i = 0; i < 1024; i++) { \
+		for (k = 0; k < 32; k++) \
+			V[i * 32 + k] = X.v[k]; \
+		SALSA(&X.v[0], &X.v[16]); \
+		SALSA(&X.v[16], &X.v[0]); \
+	} \
+	for (i = 0; i < 1024; i++) { \
+		for (l = 0; l < LANES; l++) { \
+			j = 32 * (X.w[16][l] & 1023); \
+			for (k = 0; k < 32; k++) \
+				X.w[k][l] ^= Vw[(j + k) * LANES + l]; \
+		} \
+		SALSA(&X.v[0], &X.v[16]); \
+		SALSA(&X.v[16], &X.v[0]); \
+	} \
+	for (l = 0; l < LANES; l++) { \
+		for (k = 0; k < 32; k++) \
+			le32enc(&B[l][4 * k], X.w[k][l]); \
+		PBKDF2_SHA256(&keyctx[l], B[l], 128, 1, \
+		    (uint8_t *)&output[32 * l], 32); \
+	}
+
+#define SSE2_ADD(a, b) _mm_add_epi32(a, b)
+#define SSE2_XOR(a, b) _mm_xor_si128(a, b)
+#define SSE2_ROTL(a, b) _mm_or_si128(_mm_slli_epi32(a, b), _mm_srli_epi32(a, 32 - (b)))
+
+__attribute__((target("sse2")))
+static inline void xor_salsa8_4way(__m128i B[16], const __m128i Bx[16])
+{
+	XOR_SALSA8_LANES(__m128i, SSE2_ADD, SSE2_XOR, SSE2_ROTL)
+}
+
+__attribute__((target("sse2")))
+static void scrypt_1024_1_1_256_sp_4way(const char *input, char *output, char *scratchpad, const uint32_t *midstate)
+{
+	HMAC_SHA256_CTX keyctx[4];
+	uint8_t B[4][128];
+	union {
+		__m128i v[32];
+		uint32_t w[32][4];
+	} X;
+	__m128i *V;
+	const uint32_t *Vw;
+	uint32_t i, j, k, l;
+
+	V = (__m128i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	Vw = (const uint32_t *)V;
+
+	SCRYPT_LANES_BODY(4, xor_salsa8_4way)
+}
+
+#define AVX2_ADD(a, b) _mm256_add_epi32(a, b)
+#define AVX2_XOR(a, b) _mm256_xor_si256(a, b)
+#define AVX2_ROTL(a, b) _mm256_or_si256(_mm256_slli_epi32(a, b), _mm256_srli_epi32(a, 32 - (b)))
+
+__attribute__((target("avx2")))
+static inline void xor_salsa8_8way(__m256i B[16], const __m256i Bx[16])
+{
+	XOR_SALSA8_LANES(__m256i, AVX2_ADD, AVX2_XOR, AVX2_ROTL)
+}
+
+__attribute__((target("avx2")))
+static void scrypt_1024_1_1_256_sp_8way(const char *input, char *output, char *scratchpad, const uint32_t *midstate)
+{
+	HMAC_SHA256_CTX keyctx[8];
+	uint8_t B[8][128];
+	union {
+		__m256i v[32];
+		uint32_t w[32][8];
+	} X;
+	__m256i *V;
+	const uint32_t *Vw;
+	uint32_t i, j, k, l;
+
+	V = (__m256i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+	Vw = (const uint32_t *)V;
+
+	SCRYPT_LANES_BODY(8, xor_salsa8_8way)
+}
+
+#endif /* SCRYPT_X86 */
+
+int scrypt_best_throughput(void)
+{
+	static int ways = 0;
+
+	if (ways == 0) {
+		int best = 1;
+#ifdef SCRYPT_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			best = 8;
+		else if (__builtin_cpu_supports("sse2"))
+			best = 4;
+#endif
+		ways = best;
+	}
+	return ways;
+}
+
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, char *scratchpad, int ways, const unsigned int *pmidstate)
+{
+	const uint32_t *midstate = (const uint32_t *)pmidstate;
+	int best = scrypt_best_throughput();
+
+	/* Hash the batch through the widest kernel this CPU supports, falling
+	 * back to narrower kernels for whatever is left over. */
+	while (ways > 0) {
+#ifdef SCRYPT_X86
+		if (ways >= 8 && best >= 8) {
+			scrypt_1024_1_1_256_sp_8way(input, output, scratchpad, midstate);
+			input += 8 * 80; output += 8 * 32; ways -= 8;
+			continue;
+		}
+		if (ways >= 4 && best >= 4) {
+			scrypt_1024_1_1_256_sp_4way(input, output, scratchpad, midstate);
+			input += 4 * 80; output += 4 * 32; ways -= 4;
+			continue;
+		}
+#endif
+		scrypt_1024_1_1_256_sp_1way(input, output, scratchpad, midstate);
+		input += 80; output += 32; ways -= 1;
+	}
 }
 
 void scrypt_1024_1_1_256(const char *input, char *output)
@@ -5,11 +5,25 @@
 extern "C" {
 #endif
 
+#define SCRYPT_MAX_WAYS 8
+
 const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
+const int SCRYPT_MULTI_SCRATCHPAD_SIZE = 131072 * SCRYPT_MAX_WAYS + 63;
 
 void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad);
 void scrypt_1024_1_1_256(const char *input, char *output);
 
+/* Number of nonces the widest kernel available on this CPU hashes at once
+ * (8 with AVX2, 4 with SSE2, 1 otherwise). */
+int scrypt_best_throughput(void);
+
+/* Hash ways consecutive 80-byte headers from input into ways consecutive
+ * 32-byte hashes in output.  scratchpad must be SCRYPT_MULTI_SCRATCHPAD_SIZE
+ * bytes and ways at most SCRYPT_MAX_WAYS.  If the headers share their first
+ * 64 bytes, pmidstate may point to the SHA256 state after those bytes (the
+ * midstate from FormatHashBuffers) to skip rehashing them; otherwise NULL. */
+void scrypt_1024_1_1_256_sp_multi(const char *input, char *output, char *scratchpad, int ways, const unsigned int *pmidstate);
+
 #ifdef __cplusplus
 }
 #endif
@@ -704,6 +704,8 @@ struct ser_streamplaceholder
 
 
 
+typedef std::vector<char, zero_after_free_allocator<char> > CSerializeData;
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -712,7 +714,7 @@ struct ser_streamplaceholder
 class CDataStream
 {
 protected:
-    typedef std::vector<char, zero_after_free_allocator<char> > vector_type;
+    typedef CSerializeData vector_type;
     vector_type vch;
     unsigned int nReadPos;
     short state;
@@ -790,6 +792,16 @@ public:
         return (std::string(begin(), end()));
     }
 
+    /** Move the unread data to the end of data and empty the stream */
+    void GetAndClear(CSerializeData& data)
+    {
+        if (nReadPos == 0 && data.empty())
+            vch.swap(data);
+        else
+            data.insert(data.end(), begin(), end());
+        clear();
+    }
+
 
     //
     // Vector subset
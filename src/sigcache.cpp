@@ -0,0 +1,128 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <openssl/sha.h>
+
+#include "sigcache.h"
+#include "util.h"
+
+using namespace std;
+
+CSignatureCache::CSignatureCache(unsigned int nMaxEntries)
+{
+    salt = GetRandHash();
+
+    // Power of two number of buckets, so the index is a mask of the digest
+    nBuckets = 0;
+    if (nMaxEntries > 0)
+    {
+        nBuckets = 1;
+        while (nBuckets * ENTRIES_PER_BUCKET < nMaxEntries && nBuckets < (1U << 26))
+            nBuckets <<= 1;
+    }
+
+    // Align the table so no bucket straddles two cache lines
+    pbucketsAlloc = NULL;
+    pbuckets = NULL;
+    if (nBuckets > 0)
+    {
+        pbucketsAlloc = malloc(nBuckets * sizeof(CBucket) + 63);
+        if (!pbucketsAlloc)
+            throw std::bad_alloc();
+        pbuckets = (CBucket*)(((size_t)pbucketsAlloc + 63) & ~(size_t)63);
+        memset(pbuckets, 0, nBuckets * sizeof(CBucket));
+    }
+
+    nEntries = 0;
+    nHits = 0;
+    nMisses = 0;
+    nInserts = 0;
+    nEvictions = 0;
+}
+
+CSignatureCache::~CSignatureCache()
+{
+    free(pbucketsAlloc);
+}
+
+uint256 CSignatureCache::GetDigest(const uint256& hash, const vector<unsigned char>& vchSig, const vector<unsigned char>& vchPubKey) const
+{
+    uint256 digest;
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, (const unsigned char*)&salt, sizeof(salt));
+    SHA256_Update(&ctx, (const unsigned char*)&hash, sizeof(hash));
+    if (!vchSig.empty())
+        SHA256_Update(&ctx, &vchSig[0], vchSig.size());
+    if (!vchPubKey.empty())
+        SHA256_Update(&ctx, &vchPubKey[0], vchPubKey.size());
+    SHA256_Final((unsigned char*)&digest, &ctx);
+
+    // Zero marks an empty slot
+    if (digest == 0)
+        digest = 1;
+    return digest;
+}
+
+bool CSignatureCache::Get(const uint256& hash, const vector<unsigned char>& vchSig, const vector<unsigned char>& vchPubKey)
+{
+    if (nBuckets == 0)
+        return false;
+
+    uint256 digest = GetDigest(hash, vchSig, vchPubKey);
+    unsigned int nBucket = digest.Get64(0) & (nBuckets - 1);
+    bool fFound = false;
+    {
+        LOCK(cs_stripe[nBucket % LOCK_STRIPES]);
+        const CBucket& bucket = pbuckets[nBucket];
+        for (int i = 0; i < ENTRIES_PER_BUCKET; i++)
+            if (bucket.digest[i] == digest)
+                fFound = true;
+    }
+
+    __sync_fetch_and_add(fFound ? &nHits : &nMisses, 1);
+    return fFound;
+}
+
+void CSignatureCache::Set(const uint256& hash, const vector<unsigned char>& vchSig, const vector<unsigned char>& vchPubKey)
+{
+    if (nBuckets == 0)
+        return;
+
+    uint256 digest = GetDigest(hash, vchSig, vchPubKey);
+    uint64 nIndex = digest.Get64(0);
+    unsigned int nBucket = nIndex & (nBuckets - 1);
+    {
+        LOCK(cs_stripe[nBucket % LOCK_STRIPES]);
+        CBucket& bucket = pbuckets[nBucket];
+        int nSlot = -1;
+        for (int i = 0; i < ENTRIES_PER_BUCKET; i++)
+        {
+            if (bucket.digest[i] == digest)
+                return;
+            if (nSlot < 0 && bucket.digest[i] == 0)
+                nSlot = i;
+        }
+        if (nSlot < 0)
+        {
+            // Evict one of the pair.  The digest is salted, so which one
+            // goes can't be steered from outside.
+            nSlot = (nIndex >> 32) % ENTRIES_PER_BUCKET;
+            __sync_fetch_and_add(&nEvictions, 1);
+        }
+        else
+            __sync_fetch_and_add(&nEntries, 1);
+        bucket.digest[nSlot] = digest;
+    }
+    __sync_fetch_and_add(&nInserts, 1);
+}
+
+CSignatureCache& GetSignatureCache()
+{
+    // DoS prevention: the table has a fixed size, 64 bytes per two entries.
+    // Since there are a maximum of 20,000 signature operations per block
+    // 50,000 is a reasonable default.
+    static CSignatureCache signatureCache(max((int64)0, min(GetArg("-maxsigcachesize", 50000), (int64)100000000)));
+    return signatureCache;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_SIGCACHE_H
+#define BITCOIN_SIGCACHE_H
+
+#include <vector>
+
+#include "sync.h"
+#include "uint256.h"
+
+/** Cache of signatures already found valid.
+ *
+ * Entries are salted SHA256 digests of (signature hash, signature, public
+ * key), stored in a fixed table of 64-byte buckets holding two digests
+ * each.  The salt is random per process, so an attacker cannot aim many
+ * signatures at the same bucket.  Buckets are spread over LOCK_STRIPES
+ * locks, so concurrent verification threads rarely wait on each other.
+ * A full bucket drops one of its two entries, picked by the new digest.
+ */
+class CSignatureCache
+{
+public:
+    enum { ENTRIES_PER_BUCKET = 2, LOCK_STRIPES = 64 };
+
+    /** Room for at least nMaxEntries signatures; 0 disables the cache */
+    CSignatureCache(unsigned int nMaxEntries);
+    ~CSignatureCache();
+
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& vchPubKey);
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& vchPubKey);
+
+    /** Number of entries the table can hold */
+    unsigned int GetCapacity() const { return nBuckets * ENTRIES_PER_BUCKET; }
+    /** Number of entries currently held */
+    unsigned int GetSize() const { return nEntries; }
+    /** Bytes used by the table */
+    unsigned int GetMemoryUsage() const { return nBuckets * sizeof(CBucket); }
+
+    // Counters since startup
+    int64 GetHits() const { return nHits; }
+    int64 GetMisses() const { return nMisses; }
+    int64 GetInserts() const { return nInserts; }
+    int64 GetEvictions() const { return nEvictions; }
+
+private:
+    struct CBucket
+    {
+        uint256 digest[ENTRIES_PER_BUCKET];
+    };
+
+    uint256 GetDigest(const uint256& hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& vchPubKey) const;
+
+    uint256 salt;
+    unsigned int nBuckets;
+    CBucket* pbuckets;
+    void* pbucketsAlloc;
+    CCriticalSection cs_stripe[LOCK_STRIPES];
+
+    volatile unsigned int nEntries;
+    volatile int64 nHits;
+    volatile int64 nMisses;
+    volatile int64 nInserts;
+    volatile int64 nEvictions;
+};
+
+/** The cache used by CheckSig, sized by -maxsigcachesize on first use */
+CSignatureCache& GetSignatureCache();
+
+#endif
@@ -0,0 +1,55 @@
+#include <boost/test/unit_test.hpp>
+
+#include "blockcache.h"
+
+using namespace std;
+
+static CSendBuffer MakeBuffer(unsigned int nSize)
+{
+    return CSendBuffer(new CSerializeData(nSize, 'x'));
+}
+
+BOOST_AUTO_TEST_SUITE(blockcache_tests)
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    CBlockCache cache(1000);
+    CSendBuffer buf;
+    BOOST_CHECK(!cache.Get(1, buf));
+
+    cache.Insert(1, MakeBuffer(400));
+    cache.Insert(2, MakeBuffer(400));
+    BOOST_CHECK_EQUAL(cache.GetCount(), 2U);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 800U);
+
+    // Using 1 makes 2 the oldest, so it goes first
+    BOOST_CHECK(cache.Get(1, buf));
+    BOOST_CHECK_EQUAL(buf->size(), 400U);
+    cache.Insert(3, MakeBuffer(400));
+    BOOST_CHECK(cache.Get(1, buf));
+    BOOST_CHECK(!cache.Get(2, buf));
+    BOOST_CHECK(cache.Get(3, buf));
+    BOOST_CHECK_EQUAL(cache.GetSize(), 800U);
+    BOOST_CHECK_EQUAL(cache.GetEvictions(), 1);
+    BOOST_CHECK_EQUAL(cache.GetHits(), 3);
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 2);
+
+    // An evicted buffer is still good to whoever holds it
+    CSendBuffer bufHeld;
+    BOOST_CHECK(cache.Get(1, bufHeld));
+    cache.Insert(4, MakeBuffer(900));
+    BOOST_CHECK_EQUAL(cache.GetCount(), 1U);
+    BOOST_CHECK_EQUAL(bufHeld.use_count(), 1);
+    BOOST_CHECK_EQUAL(bufHeld->size(), 400U);
+
+    // Too big to ever fit isn't kept
+    cache.Insert(5, MakeBuffer(1001));
+    BOOST_CHECK(!cache.Get(5, buf));
+    BOOST_CHECK(cache.Get(4, buf));
+
+    CBlockCache cacheOff(0);
+    cacheOff.Insert(1, MakeBuffer(1));
+    BOOST_CHECK_EQUAL(cacheOff.GetCount(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
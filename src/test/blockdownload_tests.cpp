@@ -0,0 +1,123 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+
+using namespace std;
+
+static vector<uint256> MakeChain(int nLength)
+{
+    vector<uint256> vHash;
+    for (int i = 0; i < nLength; i++)
+        vHash.push_back(GetRandHash());
+    return vHash;
+}
+
+BOOST_AUTO_TEST_SUITE(blockdownload_tests)
+
+BOOST_AUTO_TEST_CASE(blockdownload_window)
+{
+    CNode node1(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    CNode node2(INVALID_SOCKET, CAddress(CService("127.0.0.2", 0)), "", true);
+    CBlockDownload download(8, 3);
+    vector<uint256> vHash = MakeChain(20);
+    download.SetChain(1, 100, vHash, 20);
+    BOOST_CHECK_EQUAL(download.GetTipHeight(), 120);
+    BOOST_CHECK(download.GetTipHash() == vHash.back());
+
+    // Each peer gets its own share, in height order
+    vector<CInv> vGetData1, vGetData2;
+    download.GetRequests(&node1, 200, 1000, vGetData1);
+    download.GetRequests(&node2, 200, 1000, vGetData2);
+    BOOST_CHECK_EQUAL(vGetData1.size(), 3U);
+    BOOST_CHECK_EQUAL(vGetData2.size(), 3U);
+    BOOST_CHECK(vGetData1[0].hash == vHash[0]);
+    BOOST_CHECK(vGetData2[0].hash == vHash[3]);
+    BOOST_CHECK_EQUAL(download.GetInFlight(&node1), 3);
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 1);
+
+    // The window ends 8 blocks past the first missing one
+    download.BlockReceived(vHash[3], true);
+    download.BlockReceived(vHash[4], true);
+    vGetData2.clear();
+    download.GetRequests(&node2, 200, 1000, vGetData2);
+    BOOST_CHECK_EQUAL(vGetData2.size(), 2U);
+    BOOST_CHECK(vGetData2.back().hash == vHash[7]);
+
+    // The first block moves the window along, a rejected one is asked for again
+    download.BlockReceived(vHash[0], true);
+    download.BlockReceived(vHash[1], false);
+    vGetData1.clear();
+    download.GetRequests(&node1, 200, 1000, vGetData1);
+    BOOST_CHECK_EQUAL(vGetData1.size(), 2U);
+    BOOST_CHECK(vGetData1[0].hash == vHash[1]);
+    BOOST_CHECK(vGetData1[1].hash == vHash[8]);
+
+    // Nothing above what the peer has
+    download.BlockReceived(vHash[1], true);
+    download.BlockReceived(vHash[2], true);
+    CNode node3(INVALID_SOCKET, CAddress(CService("127.0.0.3", 0)), "", true);
+    vector<CInv> vGetData3;
+    download.GetRequests(&node3, 108, 1000, vGetData3);
+    BOOST_CHECK(vGetData3.empty());
+    download.GetRequests(&node3, 200, 1000, vGetData3);
+    BOOST_CHECK_EQUAL(vGetData3.size(), 3U);
+    BOOST_CHECK(vGetData3[0].hash == vHash[9]);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownload_expire)
+{
+    CNode node1(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    CNode node2(INVALID_SOCKET, CAddress(CService("127.0.0.2", 0)), "", true);
+    CBlockDownload download(100, 4);
+    vector<uint256> vHash = MakeChain(10);
+    download.SetChain(1, 0, vHash, 10);
+
+    vector<CInv> vGetData;
+    download.GetRequests(&node1, 100, 1000, vGetData);
+    download.GetRequests(&node2, 100, 1050, vGetData);
+    BOOST_CHECK_EQUAL(download.GetInFlight(), 8);
+
+    set<CNode*> setStalled;
+    download.ExpireRequests(1070, 60, setStalled);
+    BOOST_CHECK_EQUAL(setStalled.size(), 1U);
+    BOOST_CHECK(setStalled.count(&node1));
+    BOOST_CHECK_EQUAL(download.GetInFlight(&node1), 0);
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 0);
+
+    // A peer that went away gives its blocks back at once
+    node2.fDisconnect = true;
+    setStalled.clear();
+    download.ExpireRequests(1070, 60, setStalled);
+    BOOST_CHECK_EQUAL(download.GetInFlight(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownload_connected)
+{
+    CBlockDownload download(100, 4);
+    vector<uint256> vHash = MakeChain(30);
+    download.SetChain(1, 50, vHash, 30);
+
+    // Only a block of the header chain trims it
+    download.SetConnected(60, 2);
+    BOOST_CHECK_EQUAL(download.GetTipHeight(), 80);
+    BOOST_CHECK(download.Contains(vHash[5]));
+    download.SetConnected(60, vHash[9]);
+    BOOST_CHECK(!download.Contains(vHash[9]));
+    BOOST_CHECK(download.Contains(vHash[10]));
+    BOOST_CHECK(download.GetBaseHash() == vHash[9]);
+    BOOST_CHECK_EQUAL(download.GetTipHeight(), 80);
+
+    // Thins out going back, newest first
+    vector<uint256> vLocator = download.GetLocatorHashes();
+    BOOST_CHECK(vLocator[0] == vHash[29]);
+    BOOST_CHECK(vLocator[10] == vHash[19]);
+    BOOST_CHECK(vLocator[11] == vHash[17]);
+    BOOST_CHECK(vLocator.size() < 20U);
+
+    download.Extend(MakeChain(5), 40);
+    BOOST_CHECK_EQUAL(download.GetTipHeight(), 85);
+    download.SetConnected(85, download.GetTipHash());
+    BOOST_CHECK(download.IsEmpty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
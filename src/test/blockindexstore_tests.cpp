@@ -0,0 +1,99 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "blockindexstore.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+static CDiskBlockIndex MakeDiskIndex(int nHeight, const uint256& hashPrev)
+{
+    CDiskBlockIndex diskindex;
+    diskindex.hashPrev = hashPrev;
+    diskindex.nHeight = nHeight;
+    diskindex.nFile = 1;
+    diskindex.nBlockPos = 1000 + nHeight;
+    diskindex.nVersion = 1;
+    diskindex.hashMerkleRoot = GetRandHash();
+    diskindex.nTime = 1360000000 + nHeight;
+    diskindex.nBits = 0x1e0fffff;
+    diskindex.nNonce = nHeight * 7;
+    return diskindex;
+}
+
+BOOST_AUTO_TEST_SUITE(blockindexstore_tests)
+
+BOOST_AUTO_TEST_CASE(blockindexstore_roundtrip)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / strprintf("blkindex_test_%"PRI64d".map", GetRandInt(1000000000));
+
+    // Append a chain long enough to make the file grow a few times
+    vector<uint256> vHash;
+    {
+        CBlockIndexStore store;
+        BOOST_CHECK(store.Open(path));
+        BOOST_CHECK_EQUAL(store.GetCount(), 0U);
+        uint256 hashPrev = 0;
+        for (int i = 0; i < 10000; i++)
+        {
+            uint256 hash = GetRandHash();
+            BOOST_CHECK(store.Write(hash, MakeDiskIndex(i, hashPrev)));
+            vHash.push_back(hash);
+            hashPrev = hash;
+        }
+
+        // Updating a known block doesn't append
+        CDiskBlockIndex diskindex = MakeDiskIndex(5, vHash[4]);
+        diskindex.hashNext = vHash[6];
+        BOOST_CHECK(store.Write(vHash[5], diskindex));
+        BOOST_CHECK_EQUAL(store.GetCount(), 10000U);
+    }
+
+    // Everything is back after reopening, in append order
+    {
+        CBlockIndexStore store;
+        BOOST_CHECK(store.Open(path));
+        BOOST_CHECK_EQUAL(store.GetCount(), 10000U);
+        for (unsigned int n = 0; n < store.GetCount(); n++)
+        {
+            const CBlockIndexRecord& rec = store.GetRecord(n);
+            BOOST_CHECK(rec.hashBlock == vHash[n]);
+            BOOST_CHECK(rec.hashPrev == (n > 0 ? vHash[n - 1] : 0));
+            BOOST_CHECK_EQUAL(rec.nHeight, (int)n);
+            BOOST_CHECK_EQUAL(rec.nBlockPos, 1000 + n);
+        }
+        BOOST_CHECK(store.GetRecord(5).hashNext == vHash[6]);
+        BOOST_CHECK(store.GetRecord(6).hashNext == 0);
+    }
+
+    // A torn last record is dropped
+    {
+        boost::filesystem::fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekp(10000 * sizeof(CBlockIndexRecord) + 40);
+        file.put(0x5a);
+    }
+    {
+        CBlockIndexStore store;
+        BOOST_CHECK(store.Open(path));
+        BOOST_CHECK_EQUAL(store.GetCount(), 9999U);
+    }
+
+    // Damage anywhere else empties the store, to be migrated again
+    {
+        boost::filesystem::fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekp(100 * sizeof(CBlockIndexRecord) + 40);
+        file.put(0x5a);
+    }
+    {
+        CBlockIndexStore store;
+        BOOST_CHECK(store.Open(path));
+        BOOST_CHECK_EQUAL(store.GetCount(), 0U);
+        BOOST_CHECK(store.Write(vHash[0], MakeDiskIndex(0, 0)));
+        BOOST_CHECK_EQUAL(store.GetCount(), 1U);
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include "checkqueue.h"
+
+// Check that fails when its value is negative, and counts how often it ran
+class CTestCheck
+{
+public:
+    int nValue;
+    static volatile int nRuns;
+
+    CTestCheck() : nValue(0) {}
+    CTestCheck(int nValueIn) : nValue(nValueIn) {}
+
+    bool operator()()
+    {
+        __sync_fetch_and_add(&nRuns, 1);
+        return nValue >= 0;
+    }
+
+    void swap(CTestCheck& check)
+    {
+        std::swap(nValue, check.nValue);
+    }
+};
+
+volatile int CTestCheck::nRuns = 0;
+
+static void RunQueueThread(CCheckQueue<CTestCheck>* pqueue)
+{
+    pqueue->Thread();
+}
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_results)
+{
+    CCheckQueue<CTestCheck> queue(16);
+    boost::thread_group threads;
+    for (int i = 0; i < 3; i++)
+        threads.create_thread(boost::bind(&RunQueueThread, &queue));
+
+    // All good, spread over several batches
+    {
+        CTestCheck::nRuns = 0;
+        CCheckQueueControl<CTestCheck> control(&queue);
+        for (int i = 0; i < 100; i++)
+        {
+            std::vector<CTestCheck> vChecks;
+            for (int j = 0; j < i % 7; j++)
+                vChecks.push_back(CTestCheck(j));
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(control.Wait());
+        BOOST_CHECK(CTestCheck::nRuns > 0);
+    }
+
+    // One failure rejects the whole set
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        std::vector<CTestCheck> vChecks;
+        for (int i = 0; i < 500; i++)
+            vChecks.push_back(CTestCheck(i == 250 ? -1 : i));
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+
+    // The queue is reusable after a failure
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        std::vector<CTestCheck> vChecks(50, CTestCheck(1));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    // No queue means nothing to check
+    {
+        CCheckQueueControl<CTestCheck> control(NULL);
+        std::vector<CTestCheck> vChecks(1, CTestCheck(-1));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    queue.Quit();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
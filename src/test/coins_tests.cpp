@@ -0,0 +1,77 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+
+using namespace std;
+
+static CTransaction MakeTransaction(bool fCoinBase, int nOutputs)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    if (fCoinBase)
+        tx.vin[0].prevout.SetNull();
+    else
+        tx.vin[0].prevout = COutPoint(uint256(1), 0);
+    tx.vout.resize(nOutputs);
+    for (int i = 0; i < nOutputs; i++)
+    {
+        tx.vout[i].nValue = (i + 1) * COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return tx;
+}
+
+BOOST_AUTO_TEST_SUITE(coins_tests)
+
+BOOST_AUTO_TEST_CASE(coins_spend)
+{
+    CTransaction tx = MakeTransaction(false, 3);
+    CCoins coins(tx, 100);
+    BOOST_CHECK(!coins.fCoinBase);
+    BOOST_CHECK_EQUAL(coins.nHeight, 100);
+    for (unsigned int i = 0; i < 3; i++)
+        BOOST_CHECK(coins.IsAvailable(i));
+    BOOST_CHECK(!coins.IsAvailable(3));
+
+    // Spent outputs in the middle stay as placeholders, at the end they go
+    coins.Spend(1);
+    BOOST_CHECK(!coins.IsAvailable(1));
+    BOOST_CHECK_EQUAL(coins.vout.size(), 3U);
+    coins.Spend(2);
+    BOOST_CHECK_EQUAL(coins.vout.size(), 1U);
+    BOOST_CHECK(!coins.IsPruned());
+    coins.Spend(0);
+    BOOST_CHECK(coins.IsPruned());
+    BOOST_CHECK(coins.vout.empty());
+}
+
+BOOST_AUTO_TEST_CASE(coins_standin)
+{
+    CTransaction tx = MakeTransaction(true, 3);
+    CCoins coins(tx, 5);
+    coins.Spend(2);
+
+    // Serialization round trip
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << coins;
+    CCoins coins2;
+    ss >> coins2;
+    BOOST_CHECK(coins2.fCoinBase);
+    BOOST_CHECK_EQUAL(coins2.nHeight, 5);
+    BOOST_CHECK_EQUAL(coins2.vout.size(), 2U);
+
+    // The stand-in keeps the output count and coinbase flag of the original
+    CTransaction txStandIn;
+    coins2.GetTransaction(txStandIn, tx.vout.size());
+    BOOST_CHECK(txStandIn.IsCoinBase());
+    BOOST_CHECK_EQUAL(txStandIn.vout.size(), 3U);
+    BOOST_CHECK(txStandIn.vout[0] == tx.vout[0]);
+    BOOST_CHECK(txStandIn.vout[1] == tx.vout[1]);
+    BOOST_CHECK(txStandIn.vout[2].IsNull());
+
+    CCoins coins3(MakeTransaction(false, 1), 6);
+    coins3.GetTransaction(txStandIn, 1);
+    BOOST_CHECK(!txStandIn.IsCoinBase());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
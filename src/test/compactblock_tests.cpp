@@ -0,0 +1,142 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include "main.h"
+
+using namespace std;
+
+static CTransaction MakeTx(int n)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = n * CENT;
+    tx.vout[0].scriptPubKey << OP_TRUE;
+    return tx;
+}
+
+static CBlock MakeBlock(int nTx)
+{
+    CBlock block;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = 1370000000;
+    block.nBits = 0x1e0ffff0;
+    CTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].prevout.SetNull();
+    txCoinbase.vin[0].scriptSig << nTx;
+    txCoinbase.vout.resize(1);
+    txCoinbase.vout[0].nValue = 50 * COIN;
+    block.vtx.push_back(txCoinbase);
+    for (int i = 1; i < nTx; i++)
+        block.vtx.push_back(MakeTx(i));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+BOOST_AUTO_TEST_SUITE(compactblock_tests)
+
+BOOST_AUTO_TEST_CASE(compactblock_serialize)
+{
+    CBlock block = MakeBlock(10);
+    CCompactBlock cmpctblock(block);
+    BOOST_CHECK_EQUAL(cmpctblock.vShortId.size(), 9U);
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilled.size(), 1U);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << cmpctblock;
+    unsigned int nSize = ss.size();
+    CCompactBlock cmpctblock2;
+    ss >> cmpctblock2;
+    BOOST_CHECK(cmpctblock2.header.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(cmpctblock2.nNonce, cmpctblock.nNonce);
+    for (unsigned int i = 0; i < 9; i++)
+        BOOST_CHECK_EQUAL(cmpctblock2.vShortId[i].n, cmpctblock.vShortId[i].n);
+
+    // Six bytes a transaction besides the coinbase
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    CDataStream ssCoinbase(SER_NETWORK, PROTOCOL_VERSION);
+    ssCoinbase << block.vtx[0];
+    BOOST_CHECK_EQUAL(nSize, 81 + 8 + 1 + 9 * 6 + 1 + 4 + ssCoinbase.size());
+    BOOST_CHECK(nSize < ssBlock.size() / 3);
+}
+
+BOOST_AUTO_TEST_CASE(compactblock_reconstruct)
+{
+    CBlock block = MakeBlock(20);
+    CCompactBlock cmpctblock(block);
+
+    // The pool has every other transaction, and some that aren't in the block
+    map<uint256, CTransaction> mapPool;
+    for (unsigned int i = 1; i < block.vtx.size(); i += 2)
+        mapPool[block.vtx[i].GetHash()] = block.vtx[i];
+    for (int i = 0; i < 50; i++)
+    {
+        CTransaction tx = MakeTx(100 + i);
+        mapPool[tx.GetHash()] = tx;
+    }
+
+    CPartialBlock partial;
+    BOOST_CHECK(partial.Init(cmpctblock, mapPool));
+    vector<unsigned int> vMissing;
+    partial.GetMissing(vMissing);
+    BOOST_CHECK_EQUAL(vMissing.size(), 9U);
+    BOOST_CHECK_EQUAL(vMissing[0], 2U);
+    CBlock blockOut;
+    BOOST_CHECK(!partial.GetBlock(blockOut));
+
+    vector<CTransaction> vtx;
+    BOOST_FOREACH(unsigned int nIndex, vMissing)
+        vtx.push_back(block.vtx[nIndex]);
+    BOOST_CHECK(!partial.FillMissing(vector<CTransaction>(vtx.begin(), vtx.end() - 1)));
+
+    // A wrong transaction shows in the merkle root
+    CPartialBlock partialWrong = partial;
+    vector<CTransaction> vtxWrong = vtx;
+    vtxWrong[3] = MakeTx(3);
+    BOOST_CHECK(partialWrong.FillMissing(vtxWrong));
+    BOOST_CHECK(!partialWrong.GetBlock(blockOut));
+
+    BOOST_CHECK(partial.FillMissing(vtx));
+    BOOST_CHECK(partial.GetBlock(blockOut));
+    BOOST_CHECK(blockOut.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(blockOut.vtx.size(), block.vtx.size());
+    BOOST_CHECK(blockOut.vtx[19].GetHash() == block.vtx[19].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(compactblock_malformed)
+{
+    CBlock block = MakeBlock(5);
+    map<uint256, CTransaction> mapPool;
+
+    CCompactBlock cmpctblock(block);
+    cmpctblock.vPrefilled[0].nIndex = 5;
+    CPartialBlock partial;
+    BOOST_CHECK(!partial.Init(cmpctblock, mapPool));
+
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vPrefilled.push_back(cmpctblock.vPrefilled[0]);
+    cmpctblock.vShortId.pop_back();
+    BOOST_CHECK(!partial.Init(cmpctblock, mapPool));
+
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vShortId.clear();
+    cmpctblock.vPrefilled.clear();
+    BOOST_CHECK(!partial.Init(cmpctblock, mapPool));
+
+    // Two transactions with one short id are both asked for
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vShortId[1] = cmpctblock.vShortId[0];
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+        mapPool[block.vtx[i].GetHash()] = block.vtx[i];
+    BOOST_CHECK(partial.Init(cmpctblock, mapPool));
+    vector<unsigned int> vMissing;
+    partial.GetMissing(vMissing);
+    BOOST_CHECK_EQUAL(vMissing.size(), 2U);
+    BOOST_CHECK_EQUAL(vMissing[1], 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
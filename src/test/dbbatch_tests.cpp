@@ -0,0 +1,70 @@
+#include <boost/test/unit_test.hpp>
+
+#include "db.h"
+
+using namespace std;
+
+static CDBBatch::MapType MakeWrites(const string& strKey, bool fErase, const string& strValue)
+{
+    CDBBatch::CEntry entry;
+    entry.fErase = fErase;
+    entry.strValue = strValue;
+    CDBBatch::MapType mapWrites;
+    mapWrites[strKey] = entry;
+    return mapWrites;
+}
+
+BOOST_AUTO_TEST_SUITE(dbbatch_tests)
+
+BOOST_AUTO_TEST_CASE(dbbatch_pending)
+{
+    CDBBatch batch;
+    BOOST_CHECK(!batch.IsEnabled());
+    batch.SetLimits(100, 2);
+    BOOST_CHECK(batch.IsEnabled());
+
+    string strValue;
+    BOOST_CHECK_EQUAL(batch.Get("a", strValue), -1);
+
+    // Later commits replace earlier ones for the same key
+    batch.Commit(MakeWrites("a", false, "1"));
+    batch.Commit(MakeWrites("b", false, "2"));
+    BOOST_CHECK_EQUAL(batch.Get("a", strValue), 1);
+    BOOST_CHECK_EQUAL(strValue, "1");
+    batch.Commit(MakeWrites("a", false, "3"));
+    BOOST_CHECK_EQUAL(batch.Get("a", strValue), 1);
+    BOOST_CHECK_EQUAL(strValue, "3");
+    batch.Commit(MakeWrites("b", true, ""));
+    BOOST_CHECK_EQUAL(batch.Get("b", strValue), 0);
+    BOOST_CHECK_EQUAL(batch.GetSize(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(dbbatch_flushdue)
+{
+    CDBBatch batch;
+    batch.SetLimits(3, 1);
+
+    // Nothing to write is never due
+    BOOST_CHECK(!batch.IsFlushDue(true, false));
+
+    batch.Commit(MakeWrites("a", false, "1"));
+    BOOST_CHECK(batch.IsFlushDue(true, true));
+    BOOST_CHECK(!batch.IsFlushDue(false, false));
+
+    batch.BlockConnected();
+    BOOST_CHECK(batch.IsFlushDue(false, false));
+    BOOST_CHECK(!batch.IsFlushDue(false, true));
+    batch.BlockConnected();
+    batch.BlockConnected();
+    BOOST_CHECK_EQUAL(batch.GetBlockCount(), 3);
+    BOOST_CHECK(batch.IsFlushDue(false, true));
+
+    // Too many records is due regardless of blocks
+    CDBBatch batch2;
+    batch2.SetLimits(1000, 1000);
+    for (unsigned int i = 0; i < CDBBatch::MAX_RECORDS; i++)
+        batch2.Commit(MakeWrites(strprintf("%u", i), false, "x"));
+    BOOST_CHECK(batch2.IsFlushDue(false, true));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
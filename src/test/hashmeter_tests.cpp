@@ -0,0 +1,71 @@
+#include <boost/test/unit_test.hpp>
+
+#include "hashmeter.h"
+
+BOOST_AUTO_TEST_SUITE(hashmeter_tests)
+
+BOOST_AUTO_TEST_CASE(hashmeter_windows)
+{
+    CHashMeter meter;
+    int64 nStart = 1000000;
+    meter.Reset(nStart);
+
+    // 1000 hashes per second for 20 minutes, counted every 100ms
+    int64 nNow = nStart;
+    for (int i = 0; i < 20 * 60 * 10; i++)
+    {
+        nNow += 100;
+        meter.Add(100, nNow);
+    }
+    BOOST_CHECK(meter.GetTotal() == 20 * 60 * 1000);
+    BOOST_CHECK(fabs(meter.GetRate(HASHMETER_WINDOW_1S, nNow) - 1000) < 1);
+    BOOST_CHECK(fabs(meter.GetRate(HASHMETER_WINDOW_60S, nNow) - 1000) < 1);
+    BOOST_CHECK(fabs(meter.GetRate(HASHMETER_WINDOW_15M, nNow) - 1000) < 1);
+
+    // Then double speed for a minute: only the short windows follow
+    for (int i = 0; i < 60 * 10; i++)
+    {
+        nNow += 100;
+        meter.Add(200, nNow);
+    }
+    BOOST_CHECK(fabs(meter.GetRate(HASHMETER_WINDOW_1S, nNow) - 2000) < 1);
+    BOOST_CHECK(meter.GetRate(HASHMETER_WINDOW_60S, nNow) > 1950);
+    BOOST_CHECK(meter.GetRate(HASHMETER_WINDOW_15M, nNow) < 1100);
+}
+
+BOOST_AUTO_TEST_CASE(hashmeter_young)
+{
+    // A meter younger than the window reports its lifetime rate
+    CHashMeter meter;
+    meter.Reset(5000);
+    meter.Add(500, 5500);
+    meter.Add(500, 6000);
+    BOOST_CHECK(fabs(meter.GetRate(HASHMETER_WINDOW_15M, 6000) - 1000) < 1);
+    BOOST_CHECK(meter.GetRate(HASHMETER_WINDOW_60S, 5000) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(hashmeter_slots)
+{
+    int nSlot0, nSlot1;
+    CHashMeter* pmeter0 = ClaimHashMeter(nSlot0);
+    CHashMeter* pmeter1 = ClaimHashMeter(nSlot1);
+    BOOST_CHECK(pmeter0 && pmeter1 && pmeter0 != pmeter1);
+    BOOST_CHECK(nSlot0 != nSlot1);
+
+    std::vector<double> vThreadRates;
+    GetHashesPerSec(HASHMETER_WINDOW_60S, &vThreadRates);
+    BOOST_CHECK(vThreadRates.size() == 2);
+
+    ReleaseHashMeter(nSlot0);
+    GetHashesPerSec(HASHMETER_WINDOW_60S, &vThreadRates);
+    BOOST_CHECK(vThreadRates.size() == 1);
+
+    // Released slots are reused
+    int nSlot2;
+    CHashMeter* pmeter2 = ClaimHashMeter(nSlot2);
+    BOOST_CHECK(nSlot2 == nSlot0 && pmeter2 == pmeter0);
+    ReleaseHashMeter(nSlot1);
+    ReleaseHashMeter(nSlot2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,119 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "net.h"
+
+using namespace std;
+
+static vector<char> MakeMessage(const char* pszCommand, unsigned int nSize)
+{
+    CDataStream ssPayload(SER_NETWORK, PROTOCOL_VERSION);
+    for (unsigned int i = 0; i < nSize; i++)
+        ssPayload << (unsigned char)(i * 7);
+
+    CMessageHeader hdr(pszCommand, nSize);
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    ss.write(&ssPayload[0], ssPayload.size());
+    return vector<char>(ss.begin(), ss.end());
+}
+
+BOOST_AUTO_TEST_SUITE(netmessage_tests)
+
+BOOST_AUTO_TEST_CASE(netmessage_framing)
+{
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    LOCK(node.cs_vRecv);
+
+    vector<char> vData = MakeMessage("verack", 0);
+    vector<char> vBlock = MakeMessage("block", 300000);
+    vector<char> vPing = MakeMessage("ping", 8);
+    vData.insert(vData.end(), vBlock.begin(), vBlock.end());
+    vData.insert(vData.end(), vPing.begin(), vPing.end());
+
+    // Arrives in odd-sized pieces; some of the block goes in place
+    unsigned int nPos = 0;
+    while (nPos < vData.size())
+    {
+        unsigned int nSpace;
+        char* pchSpace = node.GetRecvDataSpace(nSpace);
+        if (pchSpace && nPos % 2 == 0)
+        {
+            unsigned int nBytes = min(nSpace, (unsigned int)vData.size() - nPos);
+            memcpy(pchSpace, &vData[nPos], nBytes);
+            node.RecvDataInPlace(nBytes);
+            nPos += nBytes;
+        }
+        else
+        {
+            unsigned int nBytes = min(1 + nPos % 5000, (unsigned int)vData.size() - nPos);
+            BOOST_CHECK(node.ReceiveMsgBytes(&vData[nPos], nBytes));
+            nPos += nBytes;
+        }
+    }
+
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 3U);
+    BOOST_CHECK_EQUAL(node.nRecvMessages, 3U);
+    BOOST_CHECK_EQUAL(node.nRecvSize, vData.size());
+    BOOST_CHECK_EQUAL(node.vRecvMsg[0].hdr.GetCommand(), "verack");
+    BOOST_CHECK_EQUAL(node.vRecvMsg[1].hdr.GetCommand(), "block");
+    BOOST_CHECK_EQUAL(node.vRecvMsg[2].hdr.GetCommand(), "ping");
+
+    // The payload is intact in the message's own stream
+    CDataStream& vRecv = node.vRecvMsg[1].vRecv;
+    BOOST_CHECK_EQUAL(vRecv.size(), 300000U);
+    BOOST_CHECK(memcmp(&vRecv[0], &vBlock[CMessageHeader::HEADER_SIZE], vRecv.size()) == 0);
+
+    node.PopRecvMessages(node.vRecvMsg.begin() + 2);
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    BOOST_CHECK_EQUAL(node.nRecvMessages, 1U);
+    BOOST_CHECK_EQUAL(node.nRecvSize, vPing.size());
+}
+
+BOOST_AUTO_TEST_CASE(netmessage_badheader)
+{
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    LOCK(node.cs_vRecv);
+
+    vector<char> vData = MakeMessage("ping", 8);
+    vData[0] ^= 0xff;
+    BOOST_CHECK(!node.ReceiveMsgBytes(&vData[0], vData.size()));
+
+    // An incomplete header isn't judged yet
+    CNode node2(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    {
+        LOCK(node2.cs_vRecv);
+        BOOST_CHECK(node2.ReceiveMsgBytes(&vData[4], 10));
+        BOOST_CHECK_EQUAL(node2.nRecvMessages, 0U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(netmessage_sendqueue)
+{
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    CNode node2(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+
+    // Each finished message becomes its own buffer
+    node.PushMessage("ping", (uint64)1234);
+    node.PushMessage("verack");
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 2U);
+    BOOST_CHECK_EQUAL(node.nSendSize, 2U * CMessageHeader::HEADER_SIZE + 8);
+    BOOST_CHECK(node.vSend.empty());
+
+    // A shared buffer frames the same as PushMessage and is queued, not copied
+    CDataStream ssPayload(SER_NETWORK, PROTOCOL_VERSION);
+    ssPayload << (uint64)1234;
+    CSendBuffer buf = MakeSendBuffer("ping", ssPayload);
+    BOOST_CHECK(*buf == *node.vSendMsg.front());
+    node.PushSendBuffer(buf);
+    node2.PushSendBuffer(buf);
+    BOOST_CHECK(node.vSendMsg.back() == buf);
+    BOOST_CHECK(node2.vSendMsg.back() == buf);
+    BOOST_CHECK_EQUAL(buf.use_count(), 3);
+    BOOST_CHECK_EQUAL(node2.nSendSize, buf->size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,329 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include "main.h"
+#include "relay.h"
+
+using namespace std;
+
+// How relaying worked before the scheduler, kept to benchmark against:
+// every inv is put on every node's list, and each node's list is checked
+// against an mruset and trickled with a salted SHA256 per node
+class COldRelay
+{
+public:
+    struct CPeer
+    {
+        mruset<CInv> setInventoryKnown;
+        vector<CInv> vInventoryToSend;
+        CCriticalSection cs_inventory;
+    };
+
+    vector<CPeer*> vPeers;
+    CCriticalSection cs_vNodes;
+
+    COldRelay(int nPeers)
+    {
+        for (int i = 0; i < nPeers; i++)
+        {
+            vPeers.push_back(new CPeer());
+            vPeers.back()->setInventoryKnown.max_size(SendBufferSize() / 1000);
+        }
+    }
+
+    ~COldRelay()
+    {
+        BOOST_FOREACH(CPeer* ppeer, vPeers)
+            delete ppeer;
+    }
+
+    void RelayInventory(const CInv& inv)
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CPeer* ppeer, vPeers)
+        {
+            LOCK(ppeer->cs_inventory);
+            if (!ppeer->setInventoryKnown.count(inv))
+                ppeer->vInventoryToSend.push_back(inv);
+        }
+    }
+
+    void GetInventory(CPeer* ppeer, bool fSendTrickle, vector<CInv>& vInv)
+    {
+        vector<CInv> vInvWait;
+        LOCK(ppeer->cs_inventory);
+        BOOST_FOREACH(const CInv& inv, ppeer->vInventoryToSend)
+        {
+            if (ppeer->setInventoryKnown.count(inv))
+                continue;
+            if (inv.type == MSG_TX && !fSendTrickle)
+            {
+                static uint256 hashSalt;
+                if (hashSalt == 0)
+                    hashSalt = GetRandHash();
+                uint256 hashRand = inv.hash ^ hashSalt;
+                hashRand = Hash(BEGIN(hashRand), END(hashRand));
+                if ((hashRand & 3) != 0)
+                {
+                    vInvWait.push_back(inv);
+                    continue;
+                }
+            }
+            if (ppeer->setInventoryKnown.insert(inv).second)
+                vInv.push_back(inv);
+        }
+        ppeer->vInventoryToSend = vInvWait;
+    }
+};
+
+static CNode* MakeNode(int n)
+{
+    return new CNode(INVALID_SOCKET, CAddress(CService(CNetAddr(strprintf("10.0.%d.%d", n / 256, n % 256)), 0)), "", true);
+}
+
+BOOST_AUTO_TEST_SUITE(relay_tests)
+
+BOOST_AUTO_TEST_CASE(rollingbloom)
+{
+    CRollingBloomFilter filter(100, 0.001);
+    vector<uint256> vHash;
+    for (int i = 0; i < 100; i++)
+    {
+        vHash.push_back(GetRandHash());
+        filter.Insert(vHash.back());
+    }
+    BOOST_FOREACH(const uint256& hash, vHash)
+        BOOST_CHECK(filter.Contains(hash));
+
+    int nFalse = 0;
+    for (int i = 0; i < 10000; i++)
+        if (filter.Contains(GetRandHash()))
+            nFalse++;
+    BOOST_CHECK(nFalse < 50);
+
+    // The last 100 are always there, and the first 100 gone two
+    // generations on
+    vector<uint256> vMore;
+    for (int i = 0; i < 200; i++)
+    {
+        vMore.push_back(GetRandHash());
+        filter.Insert(vMore.back());
+        for (int j = max(0, i - 99); j <= i; j++)
+            if (!filter.Contains(vMore[j]))
+                BOOST_ERROR("recent hash missing");
+    }
+    nFalse = 0;
+    BOOST_FOREACH(const uint256& hash, vHash)
+        if (filter.Contains(hash))
+            nFalse++;
+    BOOST_CHECK(nFalse < 5);
+
+    filter.Clear();
+    BOOST_CHECK(!filter.Contains(vMore.back()));
+}
+
+BOOST_AUTO_TEST_CASE(relay_trickle)
+{
+    CRelayScheduler scheduler(100);
+    CNode* pnode1 = MakeNode(1);
+    CNode* pnode2 = MakeNode(2);
+    vector<CNode*> vNodes;
+    vNodes.push_back(pnode1);
+    vNodes.push_back(pnode2);
+
+    // A node gets what is queued from when it first asks
+    vector<CInv> vInv1, vInv2;
+    scheduler.GetInventory(pnode1, false, vInv1);
+    scheduler.GetInventory(pnode2, false, vInv2);
+    scheduler.Flush(vNodes);
+    BOOST_CHECK_EQUAL(scheduler.GetBatches(), 0U);
+
+    CInv invOurs(MSG_TX, GetRandHash());
+    CInv invBlock(MSG_BLOCK, GetRandHash());
+    CInv invKnown(MSG_BLOCK, GetRandHash());
+    scheduler.Push(invOurs, true);
+    scheduler.Push(invBlock);
+    scheduler.Push(invKnown);
+    pnode2->AddInventoryKnown(invKnown);
+
+    // Nothing goes before the pass seals the batch
+    scheduler.GetInventory(pnode1, false, vInv1);
+    BOOST_CHECK(vInv1.empty());
+    scheduler.Flush(vNodes);
+
+    scheduler.GetInventory(pnode1, false, vInv1);
+    BOOST_CHECK_EQUAL(vInv1.size(), 2U);
+    BOOST_CHECK(vInv1[0].hash == invBlock.hash);
+    scheduler.GetInventory(pnode2, true, vInv2);
+    BOOST_CHECK_EQUAL(vInv2.size(), 2U);
+    BOOST_CHECK(vInv2[0].hash == invOurs.hash);
+
+    // Our own tx waits for the trickle turn, and goes only once
+    vInv1.clear();
+    scheduler.GetInventory(pnode1, true, vInv1);
+    BOOST_CHECK_EQUAL(vInv1.size(), 1U);
+    BOOST_CHECK(vInv1[0].hash == invOurs.hash);
+    scheduler.GetInventory(pnode1, true, vInv1);
+    BOOST_CHECK_EQUAL(vInv1.size(), 1U);
+    BOOST_CHECK_EQUAL(scheduler.GetAnnounced(), 5);
+    BOOST_CHECK_EQUAL(scheduler.GetFiltered(), 1);
+
+    // Batches everyone has had are dropped
+    BOOST_CHECK_EQUAL(scheduler.GetBatches(), 1U);
+    scheduler.Flush(vNodes);
+    BOOST_CHECK_EQUAL(scheduler.GetBatches(), 0U);
+
+    delete pnode1;
+    delete pnode2;
+}
+
+BOOST_AUTO_TEST_CASE(relay_lag)
+{
+    CRelayScheduler scheduler(10);
+    CNode* pnode = MakeNode(1);
+    vector<CNode*> vNodes(1, pnode);
+    vector<CInv> vInv;
+    scheduler.GetInventory(pnode, false, vInv);
+
+    // Without a trickle turn a node still gets everything once it has
+    // fallen half the window behind
+    for (int i = 0; i < 6; i++)
+    {
+        scheduler.Push(CInv(MSG_TX, GetRandHash()), true);
+        scheduler.Flush(vNodes);
+        vInv.clear();
+        scheduler.GetInventory(pnode, false, vInv);
+        BOOST_CHECK_EQUAL(vInv.size(), i < 5 ? 0U : 6U);
+    }
+    BOOST_CHECK_EQUAL(scheduler.GetBatches(), 6U);
+    scheduler.Flush(vNodes);
+    BOOST_CHECK_EQUAL(scheduler.GetBatches(), 0U);
+
+    delete pnode;
+}
+
+BOOST_AUTO_TEST_CASE(relaypool)
+{
+    CRelayPool pool(1000, 60);
+    CInv inv1(MSG_TX, GetRandHash()), inv2(MSG_TX, GetRandHash()), inv3(MSG_TX, GetRandHash());
+    CSendBuffer buf;
+    BOOST_CHECK(!pool.Get(inv1, buf));
+
+    // Every peer asking gets the one buffer
+    pool.Insert(inv1, CSendBuffer(new CSerializeData(400, 'x')), 1000);
+    pool.Insert(inv1, CSendBuffer(new CSerializeData(10, 'y')), 1001);
+    pool.Insert(inv2, CSendBuffer(new CSerializeData(400, 'x')), 1010);
+    CSendBuffer buf1, buf2;
+    BOOST_CHECK(pool.Get(inv1, buf1));
+    BOOST_CHECK(pool.Get(inv1, buf2));
+    BOOST_CHECK(buf1 == buf2);
+    BOOST_CHECK_EQUAL(buf1->size(), 400U);
+    BOOST_CHECK_EQUAL(pool.GetCount(), 2U);
+    BOOST_CHECK_EQUAL(pool.GetSize(), 800U);
+
+    // The oldest goes to keep under the budget, and a peer still holding
+    // it keeps its copy
+    pool.Insert(inv3, CSendBuffer(new CSerializeData(400, 'x')), 1020);
+    BOOST_CHECK(!pool.Get(inv1, buf));
+    BOOST_CHECK_EQUAL(buf1.use_count(), 2);
+    BOOST_CHECK_EQUAL(pool.GetEvictions(), 1);
+    BOOST_CHECK_EQUAL(pool.GetSize(), 800U);
+
+    // Then in the order they came, once they are old enough
+    pool.Expire(1071);
+    BOOST_CHECK_EQUAL(pool.GetCount(), 1U);
+    BOOST_CHECK(pool.Get(inv3, buf));
+    pool.Expire(1081);
+    BOOST_CHECK_EQUAL(pool.GetCount(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetSize(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetExpired(), 2);
+    BOOST_CHECK_EQUAL(pool.GetHits(), 3);
+    BOOST_CHECK_EQUAL(pool.GetMisses(), 2);
+
+    // Too big to ever fit isn't kept
+    pool.Insert(inv1, CSendBuffer(new CSerializeData(1001, 'x')), 1100);
+    BOOST_CHECK_EQUAL(pool.GetCount(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(relay_benchmark)
+{
+    // N peers and M tx/s, with a message handler pass every 100ms. Each
+    // tx came in from one of the peers, which mustn't get it back.
+    const int nSeconds = 10;
+    const int nPeerCounts[] = { 8, 125 };
+    const int nTxRates[] = { 10, 50 };
+    for (unsigned int p = 0; p < sizeof(nPeerCounts) / sizeof(nPeerCounts[0]); p++)
+    for (unsigned int r = 0; r < sizeof(nTxRates) / sizeof(nTxRates[0]); r++)
+    {
+        int nPeers = nPeerCounts[p];
+        int nTxPerPass = nTxRates[r] / 10;
+
+        vector<CNode*> vNodes;
+        for (int i = 0; i < nPeers; i++)
+            vNodes.push_back(MakeNode(i));
+        CRelayScheduler scheduler(1200);
+        COldRelay old(nPeers);
+
+        int64 nSent = 0, nSentOld = 0;
+        int64 nTime = 0, nTimeOld = 0;
+        vector<CInv> vInv;
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            scheduler.GetInventory(pnode, false, vInv);
+        for (int nPass = 0; nPass < nSeconds * 10; nPass++)
+        {
+            vector<CInv> vRelay;
+            vector<int> vFrom;
+            for (int i = 0; i < nTxPerPass; i++)
+            {
+                vRelay.push_back(CInv(MSG_TX, GetRandHash()));
+                vFrom.push_back(GetRand(nPeers));
+            }
+            int nTrickle = GetRand(nPeers);
+            bool fLast = (nPass == nSeconds * 10 - 1);
+
+            int64 nStart = GetTimeMicros();
+            for (int i = 0; i < nTxPerPass; i++)
+            {
+                vNodes[vFrom[i]]->AddInventoryKnown(vRelay[i]);
+                scheduler.Push(vRelay[i]);
+            }
+            scheduler.Flush(vNodes);
+            for (int i = 0; i < nPeers; i++)
+            {
+                vInv.clear();
+                scheduler.GetInventory(vNodes[i], i == nTrickle || fLast, vInv);
+                nSent += vInv.size();
+            }
+            nTime += GetTimeMicros() - nStart;
+
+            nStart = GetTimeMicros();
+            for (int i = 0; i < nTxPerPass; i++)
+            {
+                {
+                    LOCK(old.vPeers[vFrom[i]]->cs_inventory);
+                    old.vPeers[vFrom[i]]->setInventoryKnown.insert(vRelay[i]);
+                }
+                old.RelayInventory(vRelay[i]);
+            }
+            for (int i = 0; i < nPeers; i++)
+            {
+                vInv.clear();
+                old.GetInventory(old.vPeers[i], i == nTrickle || fLast, vInv);
+                nSentOld += vInv.size();
+            }
+            nTimeOld += GetTimeMicros() - nStart;
+        }
+        BOOST_TEST_MESSAGE(strprintf("relay %d peers x %d tx/s: scheduler %"PRI64d"us, per node lists %"PRI64d"us",
+                                     nPeers, nTxRates[r], nTime, nTimeOld));
+
+        // Everyone but the sender got every tx exactly once
+        int64 nExpected = (int64)nSeconds * 10 * nTxPerPass * (nPeers - 1);
+        BOOST_CHECK_EQUAL(nSent, nExpected);
+        BOOST_CHECK_EQUAL(nSentOld, nExpected);
+
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            delete pnode;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
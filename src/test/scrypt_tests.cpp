@@ -0,0 +1,75 @@
+#include <boost/test/unit_test.hpp>
+#include <openssl/sha.h>
+
+#include "uint256.h"
+#include "util.h"
+#include "scrypt.h"
+
+BOOST_AUTO_TEST_SUITE(scrypt_tests)
+
+BOOST_AUTO_TEST_CASE(scrypt_hashtest)
+{
+    // Litecoin mainnet block header and its scrypt(1024,1,1) proof-of-work hash
+    std::vector<unsigned char> vHeader = ParseHex("020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659");
+    uint256 hash;
+    scrypt_1024_1_1_256((const char*)&vHeader[0], BEGIN(hash));
+    BOOST_CHECK_EQUAL(hash.GetHex(), "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806");
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_multi_matches_scalar)
+{
+    char pheaders[80 * SCRYPT_MAX_WAYS];
+    for (unsigned int i = 0; i < sizeof(pheaders); i++)
+        pheaders[i] = (char)(i * 7 + 3);
+
+    uint256 hashRef[SCRYPT_MAX_WAYS];
+    for (int i = 0; i < SCRYPT_MAX_WAYS; i++)
+        scrypt_1024_1_1_256(&pheaders[80 * i], BEGIN(hashRef[i]));
+
+    std::vector<char> vScratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    for (int nWays = 1; nWays <= SCRYPT_MAX_WAYS; nWays++)
+    {
+        uint256 hash[SCRYPT_MAX_WAYS];
+        scrypt_1024_1_1_256_sp_multi(pheaders, BEGIN(hash), &vScratchpad[0], nWays, NULL);
+        for (int i = 0; i < nWays; i++)
+            BOOST_CHECK(hash[i] == hashRef[i]);
+    }
+
+    int nBest = scrypt_best_throughput();
+    BOOST_CHECK(nBest == 1 || nBest == 4 || nBest == 8);
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_midstate)
+{
+    // Headers that differ only in the nonce share a SHA256 midstate
+    char pheaders[80 * SCRYPT_MAX_WAYS];
+    for (unsigned int i = 0; i < 80; i++)
+        pheaders[i] = (char)(i * 13 + 5);
+    for (int i = 1; i < SCRYPT_MAX_WAYS; i++)
+    {
+        memcpy(&pheaders[80 * i], pheaders, 80);
+        pheaders[80 * i + 76] += i;
+    }
+
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, pheaders, 64);
+    unsigned int pmidstate[8];
+    for (int i = 0; i < 8; i++)
+        pmidstate[i] = ctx.h[i];
+
+    std::vector<char> vScratchpad(SCRYPT_MULTI_SCRATCHPAD_SIZE);
+    for (int nWays = 1; nWays <= SCRYPT_MAX_WAYS; nWays++)
+    {
+        uint256 hash[SCRYPT_MAX_WAYS];
+        scrypt_1024_1_1_256_sp_multi(pheaders, BEGIN(hash), &vScratchpad[0], nWays, pmidstate);
+        for (int i = 0; i < nWays; i++)
+        {
+            uint256 hashRef;
+            scrypt_1024_1_1_256(&pheaders[80 * i], BEGIN(hashRef));
+            BOOST_CHECK(hash[i] == hashRef);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
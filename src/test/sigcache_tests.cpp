@@ -0,0 +1,176 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <openssl/rand.h>
+
+#include "sigcache.h"
+#include "util.h"
+
+using namespace std;
+
+// The std::set cache CheckSig used before, kept to benchmark against
+class CSetSignatureCache
+{
+private:
+    typedef boost::tuple<uint256, std::vector<unsigned char>, std::vector<unsigned char> > sigdata_type;
+    std::set<sigdata_type> setValid;
+    CCriticalSection cs_sigcache;
+    int64 nMaxCacheSize;
+
+public:
+    CSetSignatureCache(int64 nMaxCacheSizeIn) : nMaxCacheSize(nMaxCacheSizeIn) {}
+
+    bool Get(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    {
+        LOCK(cs_sigcache);
+        return setValid.count(sigdata_type(hash, vchSig, pubKey)) > 0;
+    }
+
+    void Set(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    {
+        LOCK(cs_sigcache);
+        while (static_cast<int64>(setValid.size()) > nMaxCacheSize)
+        {
+            uint256 randomHash = GetRandHash();
+            std::vector<unsigned char> unused;
+            std::set<sigdata_type>::iterator it = setValid.lower_bound(sigdata_type(randomHash, unused, unused));
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(*it);
+        }
+        setValid.insert(sigdata_type(hash, vchSig, pubKey));
+    }
+};
+
+struct CSigData
+{
+    uint256 hash;
+    vector<unsigned char> vchSig;
+    vector<unsigned char> vchPubKey;
+};
+
+// Random DER-sized signatures and compressed-size public keys
+static vector<CSigData> MakeSigData(int nCount)
+{
+    vector<CSigData> vData(nCount);
+    for (int i = 0; i < nCount; i++)
+    {
+        vData[i].hash = GetRandHash();
+        vData[i].vchSig.resize(72);
+        vData[i].vchPubKey.resize(33);
+        RAND_bytes(&vData[i].vchSig[0], vData[i].vchSig.size());
+        RAND_bytes(&vData[i].vchPubKey[0], vData[i].vchPubKey.size());
+    }
+    return vData;
+}
+
+template<typename T>
+static void LookupAll(T* pcache, const vector<CSigData>* pvData, int nRounds)
+{
+    for (int n = 0; n < nRounds; n++)
+        BOOST_FOREACH(const CSigData& data, *pvData)
+            pcache->Get(data.hash, data.vchSig, data.vchPubKey);
+}
+
+template<typename T>
+static int64 TimeLookups(T& cache, const vector<CSigData>& vData, int nThreads, int nRounds)
+{
+    int64 nStart = GetTimeMillis();
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&LookupAll<T>, &cache, &vData, nRounds));
+    threads.join_all();
+    return GetTimeMillis() - nStart;
+}
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+BOOST_AUTO_TEST_CASE(sigcache_hits_and_misses)
+{
+    CSignatureCache cache(1000);
+    BOOST_CHECK(cache.GetCapacity() >= 1000);
+    BOOST_CHECK(cache.GetCapacity() < 2000);
+
+    vector<CSigData> vData = MakeSigData(2);
+    BOOST_CHECK(!cache.Get(vData[0].hash, vData[0].vchSig, vData[0].vchPubKey));
+    cache.Set(vData[0].hash, vData[0].vchSig, vData[0].vchPubKey);
+    BOOST_CHECK(cache.Get(vData[0].hash, vData[0].vchSig, vData[0].vchPubKey));
+    BOOST_CHECK(!cache.Get(vData[1].hash, vData[1].vchSig, vData[1].vchPubKey));
+
+    // Any part of the triple changing is a different entry
+    vector<unsigned char> vchSig = vData[0].vchSig;
+    vchSig[10] ^= 1;
+    BOOST_CHECK(!cache.Get(vData[0].hash, vchSig, vData[0].vchPubKey));
+    BOOST_CHECK(!cache.Get(vData[0].hash, vData[0].vchSig, vData[1].vchPubKey));
+    BOOST_CHECK(!cache.Get(vData[1].hash, vData[0].vchSig, vData[0].vchPubKey));
+
+    // Setting twice doesn't take a second slot
+    cache.Set(vData[0].hash, vData[0].vchSig, vData[0].vchPubKey);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 1U);
+    BOOST_CHECK_EQUAL(cache.GetHits(), 1);
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 5);
+    BOOST_CHECK_EQUAL(cache.GetInserts(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_bounded)
+{
+    CSignatureCache cache(256);
+    vector<CSigData> vData = MakeSigData(4096);
+    BOOST_FOREACH(const CSigData& data, vData)
+        cache.Set(data.hash, data.vchSig, data.vchPubKey);
+
+    BOOST_CHECK(cache.GetSize() <= cache.GetCapacity());
+    BOOST_CHECK_EQUAL(cache.GetInserts(), 4096);
+    BOOST_CHECK_EQUAL(cache.GetEvictions() + cache.GetSize(), 4096);
+
+    // The most recent entry always survives its own insertion
+    const CSigData& last = vData.back();
+    BOOST_CHECK(cache.Get(last.hash, last.vchSig, last.vchPubKey));
+
+    // A disabled cache holds nothing
+    CSignatureCache cacheOff(0);
+    cacheOff.Set(last.hash, last.vchSig, last.vchPubKey);
+    BOOST_CHECK(!cacheOff.Get(last.hash, last.vchSig, last.vchPubKey));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_benchmark)
+{
+    // Lookups of cached signatures from several verification threads, as
+    // ConnectBlock does with -par
+    const int nEntries = 20000;
+    vector<CSigData> vData = MakeSigData(nEntries);
+
+    CSignatureCache cache(50000);
+    CSetSignatureCache cacheSet(50000);
+    BOOST_FOREACH(const CSigData& data, vData)
+    {
+        cache.Set(data.hash, data.vchSig, data.vchPubKey);
+        cacheSet.Set(data.hash, data.vchSig, data.vchPubKey);
+    }
+
+    for (int nThreads = 1; nThreads <= 4; nThreads *= 2)
+    {
+        int64 nTable = TimeLookups(cache, vData, nThreads, 20);
+        int64 nSet = TimeLookups(cacheSet, vData, nThreads, 20);
+        BOOST_TEST_MESSAGE(strprintf("sigcache %d threads: table %"PRI64d"ms, set %"PRI64d"ms", nThreads, nTable, nSet));
+    }
+    // Inserting into full caches, where the set evicts at random
+    vector<CSigData> vMore = MakeSigData(nEntries);
+    CSignatureCache cacheFull(nEntries / 4);
+    CSetSignatureCache cacheSetFull(nEntries / 4);
+    int64 nStart = GetTimeMillis();
+    BOOST_FOREACH(const CSigData& data, vMore)
+        cacheFull.Set(data.hash, data.vchSig, data.vchPubKey);
+    int64 nTable = GetTimeMillis() - nStart;
+    nStart = GetTimeMillis();
+    BOOST_FOREACH(const CSigData& data, vMore)
+        cacheSetFull.Set(data.hash, data.vchSig, data.vchPubKey);
+    int64 nSet = GetTimeMillis() - nStart;
+    BOOST_TEST_MESSAGE(strprintf("sigcache full inserts: table %"PRI64d"ms (%u bytes), set %"PRI64d"ms", nTable, cacheFull.GetMemoryUsage(), nSet));
+
+    // Entries lost to full buckets miss every time
+    BOOST_CHECK_EQUAL(cache.GetHits(), (int64)20 * 7 * cache.GetSize());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
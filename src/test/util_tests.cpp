@@ -259,4 +259,33 @@ BOOST_AUTO_TEST_CASE(util_IsHex)
     BOOST_CHECK(!IsHex("0x0000"));
 }
 
+BOOST_AUTO_TEST_CASE(util_LatencyHistogram)
+{
+    CLatencyHistogram histogram;
+    BOOST_CHECK_EQUAL(histogram.percentile(0.5), 0);
+
+    // 90 fast calls and 10 slow ones
+    for (int i = 0; i < 90; i++)
+        histogram.input(100);
+    for (int i = 0; i < 10; i++)
+        histogram.input(50000);
+    histogram.input(-5);
+
+    BOOST_CHECK_EQUAL(histogram.count(), 101);
+    BOOST_CHECK_EQUAL(histogram.total(), 90 * 100 + 10 * 50000);
+    BOOST_CHECK_EQUAL(histogram.max(), 50000);
+    BOOST_CHECK_EQUAL(histogram.bucket(0), 1);
+    BOOST_CHECK_EQUAL(histogram.bucket(7), 90);
+    BOOST_CHECK_EQUAL(histogram.bucket(16), 10);
+
+    // Percentiles come out as the bucket's upper bound, capped by the max
+    BOOST_CHECK_EQUAL(histogram.percentile(0.5), 128);
+    BOOST_CHECK_EQUAL(histogram.percentile(0.9), 128);
+    BOOST_CHECK_EQUAL(histogram.percentile(0.99), 50000);
+
+    // Anything past the last bucket lands in it
+    histogram.input((int64)1 << 40);
+    BOOST_CHECK_EQUAL(histogram.bucket(CLatencyHistogram::BUCKETS - 1), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
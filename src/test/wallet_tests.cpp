@@ -53,6 +53,91 @@ static bool equal_sets(CoinSet a, CoinSet b)
     return ret.first == a.end() && ret.second == b.end();
 }
 
+// How coins were selected before the branch and bound search, kept to
+// benchmark against: 1000 stochastic passes, twice, over a copy of vCoins
+static void OldApproximateBestSubset(vector<pair<int64, pair<const CWalletTx*,unsigned int> > >vValue, int64 nTotalLower, int64 nTargetValue,
+                                     vector<char>& vfBest, int64& nBest)
+{
+    vector<char> vfIncluded;
+    vfBest.assign(vValue.size(), true);
+    nBest = nTotalLower;
+    for (int nRep = 0; nRep < 1000 && nBest != nTargetValue; nRep++)
+    {
+        vfIncluded.assign(vValue.size(), false);
+        int64 nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
+        {
+            for (unsigned int i = 0; i < vValue.size(); i++)
+            {
+                if (nPass == 0 ? rand() % 2 : !vfIncluded[i])
+                {
+                    nTotal += vValue[i].first;
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTargetValue)
+                    {
+                        fReachedTarget = true;
+                        if (nTotal < nBest)
+                        {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vValue[i].first;
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static bool OldSelectCoinsMinConf(int64 nTargetValue, vector<COutput> vCoins, CoinSet& setCoinsRet, int64& nValueRet)
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+    pair<int64, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
+    coinLowestLarger.first = std::numeric_limits<int64>::max();
+    coinLowestLarger.second.first = NULL;
+    vector<pair<int64, pair<const CWalletTx*,unsigned int> > > vValue;
+    int64 nTotalLower = 0;
+
+    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    BOOST_FOREACH(COutput output, vCoins)
+    {
+        int64 n = output.tx->vout[output.i].nValue;
+        pair<int64,pair<const CWalletTx*,unsigned int> > coin = make_pair(n, make_pair(output.tx, output.i));
+        if (n == nTargetValue)
+        {
+            setCoinsRet.insert(coin.second);
+            nValueRet += coin.first;
+            return true;
+        }
+        else if (n < nTargetValue + CENT)
+        {
+            vValue.push_back(coin);
+            nTotalLower += n;
+        }
+        else if (n < coinLowestLarger.first)
+            coinLowestLarger = coin;
+    }
+    if (nTotalLower < nTargetValue)
+        return false;
+
+    sort(vValue.rbegin(), vValue.rend());
+    vector<char> vfBest;
+    int64 nBest;
+    OldApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
+    if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
+        OldApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest);
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        if (vfBest[i])
+        {
+            setCoinsRet.insert(vValue[i].second);
+            nValueRet += vValue[i].first;
+        }
+    return true;
+}
+
 BOOST_AUTO_TEST_CASE(coin_selection_tests)
 {
     static CoinSet setCoinsRet, setCoinsRet2;
@@ -292,4 +377,232 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_benchmark)
+{
+    // A wallet of N mining payouts of up to half a coin, paying out a few
+    // coins at a time
+    const int nCoinCounts[] = { 1000, 10000 };
+    for (unsigned int p = 0; p < sizeof(nCoinCounts) / sizeof(nCoinCounts[0]); p++)
+    {
+        empty_wallet();
+        for (int i = 0; i < nCoinCounts[p]; i++)
+            add_coin(CENT / 10 + GetRand(50 * CENT));
+
+        int64 nTime = 0, nTimeOld = 0;
+        int64 nChange = 0, nChangeOld = 0;
+        int nInputs = 0, nInputsOld = 0;
+        for (int n = 0; n < 10; n++)
+        {
+            int64 nTarget = (n + 1) * COIN + GetRand(COIN);
+            CoinSet setCoins;
+            int64 nValue;
+
+            int64 nStart = GetTimeMicros();
+            BOOST_CHECK(wallet.SelectCoinsMinConf(nTarget, 1, 6, vCoins, setCoins, nValue));
+            nTime += GetTimeMicros() - nStart;
+            BOOST_CHECK(nValue >= nTarget);
+            nChange += nValue - nTarget;
+            nInputs += setCoins.size();
+
+            nStart = GetTimeMicros();
+            BOOST_CHECK(OldSelectCoinsMinConf(nTarget, vCoins, setCoins, nValue));
+            nTimeOld += GetTimeMicros() - nStart;
+            nChangeOld += nValue - nTarget;
+            nInputsOld += setCoins.size();
+        }
+        BOOST_TEST_MESSAGE(strprintf("select from %d coins: branch and bound %"PRI64d"us, %d inputs, %s change; stochastic %"PRI64d"us, %d inputs, %s change",
+                                     nCoinCounts[p], nTime, nInputs, FormatMoney(nChange).c_str(), nTimeOld, nInputsOld, FormatMoney(nChangeOld).c_str()));
+    }
+    empty_wallet();
+}
+
+BOOST_AUTO_TEST_CASE(consolidation_select)
+{
+    vector<COutput> vSweep;
+    empty_wallet();
+    wallet.consolidation.SetNull();
+    wallet.consolidation.nMinInputs = 3;
+    wallet.consolidation.nMaxInputs = 4;
+
+    // Too big, too new, and not enough of the rest
+    add_coin(2 * COIN);
+    add_coin(COIN);
+    add_coin(CENT, 1);
+    add_coin(3 * CENT);
+    add_coin(5 * CENT);
+    BOOST_CHECK(!wallet.SelectConsolidationCoins(vCoins, vSweep));
+    BOOST_CHECK(vSweep.empty());
+
+    // The smallest go first, up to the most for one sweep
+    add_coin(4 * CENT);
+    add_coin(2 * CENT);
+    add_coin(50 * CENT);
+    add_coin(6 * CENT);
+    BOOST_CHECK(wallet.SelectConsolidationCoins(vCoins, vSweep));
+    BOOST_CHECK_EQUAL(vSweep.size(), 4U);
+    int64 nTotal = 0;
+    BOOST_FOREACH(const COutput& out, vSweep)
+        nTotal += out.tx->vout[out.i].nValue;
+    BOOST_CHECK_EQUAL(nTotal, 14 * CENT);
+
+    wallet.consolidation.nMaxInputValue = 5 * CENT;
+    BOOST_CHECK(wallet.SelectConsolidationCoins(vCoins, vSweep));
+    BOOST_CHECK_EQUAL(vSweep.size(), 3U);
+    wallet.consolidation.nMinDepth = 200;
+    BOOST_CHECK(!wallet.SelectConsolidationCoins(vCoins, vSweep));
+
+    wallet.consolidation.SetNull();
+    empty_wallet();
+}
+
+BOOST_AUTO_TEST_CASE(unspent_index)
+{
+    CWallet wallet;
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(wallet.AddKey(key));
+    CScript scriptMine, scriptOther;
+    scriptMine.SetDestination(key.GetPubKey().GetID());
+    scriptOther << OP_TRUE;
+
+    // Unconfirmed payments to us of 1 to 10 coins, each with an output
+    // that isn't ours, and one that pays only someone else
+    vector<uint256> vHash;
+    for (int i = 0; i <= 10; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vout.resize(2);
+        tx.vout[0].nValue = (i + 1) * COIN;
+        tx.vout[0].scriptPubKey = (i < 10 ? scriptMine : scriptOther);
+        tx.vout[1].nValue = COIN;
+        tx.vout[1].scriptPubKey = scriptOther;
+        wallet.mapWallet[tx.GetHash()] = CWalletTx(&wallet, tx);
+        vHash.push_back(tx.GetHash());
+    }
+    wallet.ReindexUnspent();
+
+    vector<COutput> vCoins;
+    wallet.AvailableCoins(vCoins, false);
+    BOOST_CHECK_EQUAL(vCoins.size(), 10U);
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK(vCoins.empty());
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 55 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 0);
+
+    // Spending the output takes the transaction out, and the totals follow
+    CWalletTx& wtx = wallet.mapWallet[vHash[9]];
+    wtx.MarkSpent(0);
+    wallet.UpdateUnspent(wtx);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 45 * COIN);
+    wallet.AvailableCoins(vCoins, false);
+    BOOST_CHECK_EQUAL(vCoins.size(), 9U);
+    BOOST_FOREACH(const COutput& out, vCoins)
+        BOOST_CHECK(out.tx->GetHash() != vHash[9]);
+
+    // Rebuilding from scratch agrees
+    wallet.MarkDirty();
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 45 * COIN);
+    wallet.AvailableCoins(vCoins, false);
+    BOOST_CHECK_EQUAL(vCoins.size(), 9U);
+
+    // Going through them four transactions at a time finds the same
+    vector<COutput> vPage;
+    set<uint256> setSeen;
+    uint256 hashLast = 0;
+    int nPages = 0;
+    bool fMore = true;
+    while (fMore)
+    {
+        fMore = wallet.AvailableCoins(vPage, false, nPages ? &hashLast : NULL, 4, hashLast);
+        BOOST_CHECK(vPage.size() <= 4);
+        BOOST_FOREACH(const COutput& out, vPage)
+            BOOST_CHECK(setSeen.insert(out.tx->GetHash()).second);
+        nPages++;
+    }
+    BOOST_CHECK_EQUAL(nPages, 3);
+    BOOST_CHECK_EQUAL(setSeen.size(), 9U);
+
+    // What the address received counts spent outputs too
+    int nConf;
+    BOOST_CHECK_EQUAL(wallet.GetAddressReceived(key.GetPubKey().GetID(), 0, nConf), 55 * COIN);
+    BOOST_CHECK_EQUAL(nConf, 0);
+    BOOST_CHECK_EQUAL(wallet.GetAddressReceived(key.GetPubKey().GetID(), 1, nConf), 0);
+}
+
+BOOST_AUTO_TEST_CASE(account_index)
+{
+    CWallet wallet;
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    wallet.AddKey(key1);
+    wallet.AddKey(key2);
+    wallet.SetAddressBookName(key1.GetPubKey().GetID(), "alice");
+    CScript script1, script2;
+    script1.SetDestination(key1.GetPubKey().GetID());
+    script2.SetDestination(key2.GetPubKey().GetID());
+
+    // Unconfirmed payments, alice's at odd times and the unlabelled
+    // address's at even ones
+    for (int i = 1; i <= 5; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i * COIN;
+        tx.vout[0].scriptPubKey = (i % 2 ? script1 : script2);
+        CWalletTx& wtx = wallet.mapWallet[tx.GetHash()];
+        wtx = CWalletTx(&wallet, tx);
+        wtx.nTimeReceived = i * 100;
+    }
+    wallet.ReindexAccounts();
+
+    CAccountingEntry debit, credit;
+    debit.strAccount = credit.strOtherAccount = "alice";
+    credit.strAccount = debit.strOtherAccount = "bob";
+    debit.nCreditDebit = -COIN;
+    credit.nCreditDebit = COIN;
+    debit.nTime = credit.nTime = 600;
+    wallet.AddAccountingEntry(debit);
+    wallet.AddAccountingEntry(credit);
+
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(wallet.GetAccountItems("*").size(), 7U);
+        const CWallet::TxItems& txItems = wallet.GetAccountItems("alice");
+        BOOST_CHECK_EQUAL(txItems.size(), 4U);
+        BOOST_CHECK(txItems.rbegin()->second.second != NULL);
+        BOOST_CHECK_EQUAL(txItems.begin()->second.first->GetTxTime(), 100);
+        BOOST_CHECK_EQUAL(wallet.GetAccountItems("").size(), 2U);
+        BOOST_CHECK(wallet.GetAccountItems("nobody").empty());
+    }
+
+    BOOST_CHECK_EQUAL(wallet.GetAccountBalance("alice", 0), 8 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetAccountBalance("alice", 1), -COIN);
+    BOOST_CHECK_EQUAL(wallet.GetAccountBalance("bob", 1), COIN);
+    BOOST_CHECK_EQUAL(wallet.GetAccountBalance("bob", ACCOUNT_SETTLED_DEPTH + 1), COIN);
+    BOOST_CHECK_EQUAL(wallet.GetAccountBalance("", 0), 6 * COIN);
+
+    // Labelling the address moves what it received
+    wallet.SetAddressBookName(key2.GetPubKey().GetID(), "carol");
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.GetAccountItems("").empty());
+        BOOST_CHECK_EQUAL(wallet.GetAccountItems("carol").size(), 2U);
+        BOOST_CHECK_EQUAL(wallet.GetAccountItems("*").size(), 7U);
+    }
+    BOOST_CHECK_EQUAL(wallet.GetAccountBalance("", 0), 0);
+    BOOST_CHECK_EQUAL(wallet.GetAccountBalance("carol", 0), 6 * COIN);
+
+    map<string, int64> mapBalances;
+    wallet.GetAccountBalances(mapBalances, 0);
+    BOOST_CHECK_EQUAL(mapBalances["alice"], 8 * COIN);
+    BOOST_CHECK_EQUAL(mapBalances["bob"], COIN);
+    BOOST_CHECK_EQUAL(mapBalances["carol"], 6 * COIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
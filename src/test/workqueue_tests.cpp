@@ -0,0 +1,63 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include "workqueue.h"
+
+static void RunWorker(CWorkQueue<int>* pqueue, volatile int* pnSum)
+{
+    int n;
+    while (pqueue->Pop(n))
+        __sync_fetch_and_add(pnSum, n);
+}
+
+BOOST_AUTO_TEST_SUITE(workqueue_tests)
+
+BOOST_AUTO_TEST_CASE(workqueue_bounded)
+{
+    CWorkQueue<int> queue(3);
+    BOOST_CHECK(queue.Push(1));
+    BOOST_CHECK(queue.Push(2));
+    BOOST_CHECK(queue.Push(3));
+    BOOST_CHECK(!queue.Push(4));
+    BOOST_CHECK_EQUAL(queue.Depth(), 3U);
+
+    // First in, first out
+    int n;
+    BOOST_CHECK(queue.Pop(n));
+    BOOST_CHECK_EQUAL(n, 1);
+    BOOST_CHECK(queue.Push(4));
+    BOOST_CHECK(queue.Pop(n));
+    BOOST_CHECK_EQUAL(n, 2);
+
+    // Interrupting drops what is waiting and turns new work away
+    queue.Interrupt();
+    BOOST_CHECK_EQUAL(queue.Depth(), 0U);
+    BOOST_CHECK(!queue.Pop(n));
+    BOOST_CHECK(!queue.Push(5));
+}
+
+BOOST_AUTO_TEST_CASE(workqueue_workers)
+{
+    CWorkQueue<int> queue(1000);
+    volatile int nSum = 0;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(boost::bind(&RunWorker, &queue, &nSum));
+
+    int nExpected = 0;
+    for (int i = 1; i <= 10000; i++)
+    {
+        while (!queue.Push(i))
+            boost::this_thread::yield();
+        nExpected += i;
+    }
+    while (queue.Depth() > 0 || nSum != nExpected)
+        boost::this_thread::yield();
+
+    // Workers blocked on an empty queue all wake up to exit
+    queue.Interrupt();
+    threadGroup.join_all();
+    BOOST_CHECK_EQUAL(nSum, nExpected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -56,6 +56,12 @@ namespace boost {
 # include <sys/prctl.h>
 #endif
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 using namespace std;
 
 map<string, string> mapArgs;
@@ -1156,6 +1162,7 @@ void SetMockTime(int64 nMockTimeIn)
 }
 
 static int64 nTimeOffset = 0;
+static CCriticalSection cs_nTimeOffset;
 
 int64 GetAdjustedTime()
 {
@@ -1164,6 +1171,7 @@ int64 GetAdjustedTime()
 
 void AddTimeData(const CNetAddr& ip, int64 nTime)
 {
+    LOCK(cs_nTimeOffset);
     int64 nOffsetSample = nTime - GetTime();
 
     // Ignore duplicates
@@ -1288,3 +1296,66 @@ void RenameThread(const char* name)
     (void)name;
 #endif
 }
+
+bool SetThreadAffinity(int nCPU)
+{
+#if defined(WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << nCPU) != 0;
+#elif defined(__linux__) && defined(CPU_SET)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(nCPU, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#else
+    (void)nCPU;
+    return false;
+#endif
+}
+
+// Huge pages are 2MB on the platforms that have them; round up so the
+// same size is passed to mmap and munmap.
+static size_t HugePageRoundUp(size_t nSize)
+{
+    static const size_t nHugePageSize = 2 * 1024 * 1024;
+    return (nSize + nHugePageSize - 1) & ~(nHugePageSize - 1);
+}
+
+// Allocate nSize bytes of page-aligned memory, backed by huge pages where
+// the OS allows it.  Pages are not touched here, so with the default
+// first-touch policy they end up on the NUMA node of the thread that
+// first writes to them.
+void* AllocHugePages(size_t nSize)
+{
+#ifdef WIN32
+    return VirtualAlloc(NULL, nSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    nSize = HugePageRoundUp(nSize);
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    p = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED)
+    {
+        // No reserved huge pages, fall back to normal pages and ask for
+        // transparent huge pages instead
+        p = mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(p, nSize, MADV_HUGEPAGE);
+#endif
+    }
+    return p;
+#endif
+}
+
+void FreeHugePages(void* p, size_t nSize)
+{
+    if (!p)
+        return;
+#ifdef WIN32
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, HugePageRoundUp(nSize));
+#endif
+}
@@ -296,6 +296,12 @@ inline int64 GetTimeMillis()
             boost::posix_time::ptime(boost::gregorian::date(1970,1,1))).total_milliseconds();
 }
 
+inline int64 GetTimeMicros()
+{
+    return (boost::posix_time::ptime(boost::posix_time::microsec_clock::universal_time()) -
+            boost::posix_time::ptime(boost::gregorian::date(1970,1,1))).total_microseconds();
+}
+
 inline std::string DateTimeStrFormat(const char* pszFormat, int64 nTime)
 {
     time_t n = nTime;
@@ -547,6 +553,65 @@ public:
     }
 };
 
+/** Histogram of latencies in microseconds.
+ * Bucket n counts the samples below 2^n us (and at least 2^(n-1)), so
+ * percentiles can be told to within a factor of two without keeping the
+ * samples themselves.
+ */
+class CLatencyHistogram
+{
+public:
+    enum { BUCKETS = 32 };
+
+private:
+    int64 vCount[BUCKETS];
+    int64 nCount;
+    int64 nTotal;
+    int64 nMax;
+
+public:
+    CLatencyHistogram()
+    {
+        memset(vCount, 0, sizeof(vCount));
+        nCount = 0;
+        nTotal = 0;
+        nMax = 0;
+    }
+
+    void input(int64 nMicros)
+    {
+        if (nMicros < 0)
+            nMicros = 0;
+        int n = 0;
+        while (n < BUCKETS - 1 && (nMicros >> n) != 0)
+            n++;
+        vCount[n]++;
+        nCount++;
+        nTotal += nMicros;
+        if (nMicros > nMax)
+            nMax = nMicros;
+    }
+
+    /** Upper bound of the latency below which dFraction of the samples fall */
+    int64 percentile(double dFraction) const
+    {
+        int64 nWant = (int64)(dFraction * nCount + 0.5);
+        int64 nSeen = 0;
+        for (int n = 0; n < BUCKETS; n++)
+        {
+            nSeen += vCount[n];
+            if (nSeen >= nWant && nSeen > 0)
+                return std::min((int64)1 << n, nMax);
+        }
+        return nMax;
+    }
+
+    int64 bucket(int n) const { return vCount[n]; }
+    int64 count() const { return nCount; }
+    int64 total() const { return nTotal; }
+    int64 max() const { return nMax; }
+};
+
 
 
 
@@ -630,6 +695,9 @@ inline void ExitThread(size_t nExitCode)
 #endif
 
 void RenameThread(const char* name);
+bool SetThreadAffinity(int nCPU);
+void* AllocHugePages(size_t nSize);
+void FreeHugePages(void* p, size_t nSize);
 
 inline uint32_t ByteReverse(uint32_t value)
 {
@@ -31,7 +31,7 @@ extern const std::string CLIENT_DATE;
 //
 // network protocol versioning
 //
-static const int PROTOCOL_VERSION = 60002;
+static const int PROTOCOL_VERSION = 60003;
 
 // Earlier versions not supported after height 31500
 // New fees kick in, and new diff. rules too.
@@ -49,4 +49,7 @@ static const int NOBLKS_VERSION_END = 32400;
 // BIP 0031, pong message, is enabled for all versions AFTER this one
 static const int BIP0031_VERSION = 60000;
 
+// cmpctblock, getblocktxn and blocktxn, for peers that also set NODE_COMPACT_BLOCKS
+static const int COMPACT_BLOCKS_VERSION = 60003;
+
 #endif
@@ -311,6 +311,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx)
                 {
                     printf("WalletUpdateSpent found spent coin %sbc %s\n", FormatMoney(wtx.GetCredit()).c_str(), wtx.GetHash().ToString().c_str());
                     wtx.MarkSpent(txin.prevout.n);
+                    UpdateUnspent(wtx);
                     wtx.WriteToDisk();
                     NotifyTransactionChanged(this, txin.prevout.hash, CT_UPDATED);
                 }
@@ -325,9 +326,297 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+
+        // What is ours may have changed too
+        ReindexUnspent();
+    ReindexAccounts();
+        ReindexAccounts();
+    }
+}
+
+void CWallet::UpdateUnspent(const CWalletTx& wtx)
+{
+    {
+        LOCK(cs_wallet);
+        bool fUnspent = false;
+        for (unsigned int i = 0; i < wtx.vout.size() && !fUnspent; i++)
+            if (!wtx.IsSpent(i) && IsMine(wtx.vout[i]))
+                fUnspent = true;
+        if (fUnspent)
+            setUnspent.insert(wtx.GetHash());
+        else
+            setUnspent.erase(wtx.GetHash());
+        fBalanceCached = false;
+    }
+}
+
+void CWallet::ReindexUnspent()
+{
+    {
+        LOCK(cs_wallet);
+        setUnspent.clear();
+        BOOST_FOREACH(const PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
+            UpdateUnspent(item.second);
+    }
+}
+
+// What wtx adds to the balance of strAccount, as GetAccountBalance counts it
+static int64 GetAccountTxBalance(const CWalletTx& wtx, const string& strAccount, int nMinDepth)
+{
+    if (!wtx.IsFinal())
+        return 0;
+
+    int64 nGenerated, nReceived, nSent, nFee;
+    wtx.GetAccountAmounts(strAccount, nGenerated, nReceived, nSent, nFee);
+
+    int64 nBalance = nGenerated - nSent - nFee;
+    if (nReceived != 0 && wtx.GetDepthInMainChain() >= nMinDepth)
+        nBalance += nReceived;
+    return nBalance;
+}
+
+void CWallet::IndexAccountTx(CWalletTx& wtx)
+{
+    uint256 hash = wtx.GetHash();
+    UnindexAccountTx(hash);
+    CAccountTx& entry = mapAccountTx[hash];
+    entry.nTime = wtx.GetTxTime();
+    entry.fSettled = false;
+
+    // The same accounts ListTransactions shows it under
+    int64 nGeneratedImmature, nGeneratedMature, nFee;
+    string strSentAccount;
+    list<pair<CTxDestination, int64> > listReceived;
+    list<pair<CTxDestination, int64> > listSent;
+    wtx.GetAmounts(nGeneratedImmature, nGeneratedMature, listReceived, listSent, nFee, strSentAccount);
+
+    set<string> setAccount;
+    if (nGeneratedImmature + nGeneratedMature != 0)
+        setAccount.insert("");
+    if (!listSent.empty() || nFee != 0)
+        setAccount.insert(strSentAccount);
+    BOOST_FOREACH(const PAIRTYPE(CTxDestination, int64)& r, listReceived)
+    {
+        map<CTxDestination, string>::const_iterator mi = mapAddressBook.find(r.first);
+        setAccount.insert(mi == mapAddressBook.end() ? string("") : (*mi).second);
+    }
+    entry.vAccount.assign(setAccount.begin(), setAccount.end());
+
+    // Change is in too: if its address is labelled later the tx gets listed
+    // under the label
+    set<CTxDestination> setReceived;
+    BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+    {
+        CTxDestination address;
+        if (ExtractDestination(txout.scriptPubKey, address) && ::IsMine(*this, address) && setReceived.insert(address).second)
+        {
+            entry.vReceived.push_back(address);
+            mapAddressTx[address].insert(hash);
+        }
+    }
+
+    TxPair item(&wtx, (CAccountingEntry*)0);
+    mapAccountItems["*"].insert(make_pair(entry.nTime, item));
+    BOOST_FOREACH(const string& strAccount, entry.vAccount)
+        if (strAccount != "*")
+            mapAccountItems[strAccount].insert(make_pair(entry.nTime, item));
+
+    setAccountUnsettled.insert(hash);
+}
+
+void CWallet::UnindexAccountTx(const uint256& hash)
+{
+    map<uint256, CAccountTx>::iterator mi = mapAccountTx.find(hash);
+    if (mi == mapAccountTx.end())
+        return;
+    CAccountTx& entry = (*mi).second;
+    const CWalletTx* pwtx = &mapWallet[hash];
+
+    vector<string> vAccount = entry.vAccount;
+    vAccount.push_back("*");
+    BOOST_FOREACH(const string& strAccount, vAccount)
+    {
+        TxItems& txItems = mapAccountItems[strAccount];
+        pair<TxItems::iterator, TxItems::iterator> range = txItems.equal_range(entry.nTime);
+        for (TxItems::iterator it = range.first; it != range.second; ++it)
+        {
+            if ((*it).second.first == pwtx)
+            {
+                txItems.erase(it);
+                break;
+            }
+        }
+        if (txItems.empty())
+            mapAccountItems.erase(strAccount);
+    }
+
+    BOOST_FOREACH(const CTxDestination& address, entry.vReceived)
+    {
+        mapAddressTx[address].erase(hash);
+        if (mapAddressTx[address].empty())
+            mapAddressTx.erase(address);
+    }
+
+    for (unsigned int i = 0; i < entry.vSettled.size(); i++)
+        mapAccountSettled[entry.vSettled[i].first] -= entry.vSettled[i].second;
+    setAccountUnsettled.erase(hash);
+    mapAccountTx.erase(mi);
+}
+
+void CWallet::IndexAccountingEntry(CAccountingEntry& acentry)
+{
+    TxPair item((CWalletTx*)0, &acentry);
+    mapAccountItems["*"].insert(make_pair(acentry.nTime, item));
+    if (acentry.strAccount != "*")
+        mapAccountItems[acentry.strAccount].insert(make_pair(acentry.nTime, item));
+    mapAccountSettled[acentry.strAccount] += acentry.nCreditDebit;
+}
+
+void CWallet::AddAccountingEntry(const CAccountingEntry& acentry)
+{
+    LOCK(cs_wallet);
+    laccentries.push_back(acentry);
+    IndexAccountingEntry(laccentries.back());
+}
+
+void CWallet::ReindexAccounts()
+{
+    {
+        LOCK(cs_wallet);
+        mapAccountItems.clear();
+        mapAccountTx.clear();
+        mapAddressTx.clear();
+        mapAccountSettled.clear();
+        setAccountUnsettled.clear();
+        BOOST_FOREACH(CAccountingEntry& acentry, laccentries)
+            IndexAccountingEntry(acentry);
+        for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            IndexAccountTx((*it).second);
     }
 }
 
+// Move the transactions that have got deep enough into the running totals
+void CWallet::SettleAccountTxs()
+{
+    for (set<uint256>::iterator it = setAccountUnsettled.begin(); it != setAccountUnsettled.end(); )
+    {
+        const CWalletTx& wtx = mapWallet[*it];
+        if (wtx.GetDepthInMainChain() < ACCOUNT_SETTLED_DEPTH)
+        {
+            ++it;
+            continue;
+        }
+
+        CAccountTx& entry = mapAccountTx[*it];
+        BOOST_FOREACH(const string& strAccount, entry.vAccount)
+        {
+            int64 nBalance = GetAccountTxBalance(wtx, strAccount, 0);
+            entry.vSettled.push_back(make_pair(strAccount, nBalance));
+            mapAccountSettled[strAccount] += nBalance;
+        }
+        entry.fSettled = true;
+        setAccountUnsettled.erase(it++);
+    }
+}
+
+const CWallet::TxItems& CWallet::GetAccountItems(const string& strAccount) const
+{
+    static const TxItems txItemsEmpty;
+    map<string, TxItems>::const_iterator mi = mapAccountItems.find(strAccount);
+    if (mi == mapAccountItems.end())
+        return txItemsEmpty;
+    return (*mi).second;
+}
+
+int64 CWallet::GetAccountBalance(const string& strAccount, int nMinDepth)
+{
+    LOCK(cs_wallet);
+    int64 nBalance = 0;
+    if (nMinDepth > ACCOUNT_SETTLED_DEPTH)
+    {
+        // Deeper than the running totals go, so tally the account's items
+        const TxItems& txItems = GetAccountItems(strAccount);
+        for (TxItems::const_iterator it = txItems.begin(); it != txItems.end(); ++it)
+        {
+            if ((*it).second.first)
+                nBalance += GetAccountTxBalance(*(*it).second.first, strAccount, nMinDepth);
+            else
+                nBalance += (*it).second.second->nCreditDebit;
+        }
+        return nBalance;
+    }
+
+    SettleAccountTxs();
+    map<string, int64>::const_iterator mi = mapAccountSettled.find(strAccount);
+    if (mi != mapAccountSettled.end())
+        nBalance = (*mi).second;
+    BOOST_FOREACH(const uint256& hash, setAccountUnsettled)
+    {
+        const vector<string>& vAccount = mapAccountTx[hash].vAccount;
+        if (find(vAccount.begin(), vAccount.end(), strAccount) != vAccount.end())
+            nBalance += GetAccountTxBalance(mapWallet[hash], strAccount, nMinDepth);
+    }
+    return nBalance;
+}
+
+void CWallet::GetAccountBalances(map<string, int64>& mapBalances, int nMinDepth)
+{
+    LOCK(cs_wallet);
+    if (nMinDepth > ACCOUNT_SETTLED_DEPTH)
+    {
+        for (map<string, TxItems>::const_iterator mi = mapAccountItems.begin(); mi != mapAccountItems.end(); ++mi)
+            if ((*mi).first != "*")
+                mapBalances[(*mi).first] += GetAccountBalance((*mi).first, nMinDepth);
+        return;
+    }
+
+    SettleAccountTxs();
+    for (map<string, int64>::const_iterator mi = mapAccountSettled.begin(); mi != mapAccountSettled.end(); ++mi)
+        mapBalances[(*mi).first] += (*mi).second;
+    BOOST_FOREACH(const uint256& hash, setAccountUnsettled)
+    {
+        const CWalletTx& wtx = mapWallet[hash];
+        BOOST_FOREACH(const string& strAccount, mapAccountTx[hash].vAccount)
+            mapBalances[strAccount] += GetAccountTxBalance(wtx, strAccount, nMinDepth);
+    }
+}
+
+int64 CWallet::GetAddressReceived(const CTxDestination& address, int nMinDepth, int& nConfRet) const
+{
+    int64 nAmount = 0;
+    nConfRet = std::numeric_limits<int>::max();
+
+    LOCK(cs_wallet);
+    map<CTxDestination, set<uint256> >::const_iterator mi = mapAddressTx.find(address);
+    if (mi == mapAddressTx.end())
+        return 0;
+    BOOST_FOREACH(const uint256& hash, (*mi).second)
+    {
+        map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = (*it).second;
+
+        if (wtx.IsCoinBase() || !wtx.IsFinal())
+            continue;
+
+        int nDepth = wtx.GetDepthInMainChain();
+        if (nDepth < nMinDepth)
+            continue;
+
+        BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+        {
+            CTxDestination dest;
+            if (ExtractDestination(txout.scriptPubKey, dest) && dest == address)
+            {
+                nAmount += txout.nValue;
+                nConfRet = min(nConfRet, nDepth);
+            }
+        }
+    }
+    return nAmount;
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn)
 {
     uint256 hash = wtxIn.GetHash();
@@ -363,6 +652,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
             }
             fUpdated |= wtx.UpdateSpent(wtxIn.vfSpent);
         }
+        UpdateUnspent(wtx);
+        IndexAccountTx(wtx);
 
         //// debug print
         printf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString().substr(0,10).c_str(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
@@ -436,8 +727,11 @@ bool CWallet::EraseFromWallet(uint256 hash)
         return false;
     {
         LOCK(cs_wallet);
+        UnindexAccountTx(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        setUnspent.erase(hash);
+        fBalanceCached = false;
     }
     return true;
 }
@@ -869,6 +1163,7 @@ void CWallet::ReacceptWalletTransactions()
                 {
                     printf("ReacceptWalletTransactions found spent coin %sbc %s\n", FormatMoney(wtx.GetCredit()).c_str(), wtx.GetHash().ToString().c_str());
                     wtx.MarkDirty();
+                    UpdateUnspent(wtx);
                     wtx.WriteToDisk();
                 }
             }
@@ -905,7 +1200,7 @@ void CWalletTx::RelayWalletTransaction(CTxDB& txdb)
         if (!txdb.ContainsTx(hash))
         {
             printf("Relaying wtx %s\n", hash.ToString().substr(0,10).c_str());
-            RelayMessage(CInv(MSG_TX, hash), (CTransaction)*this);
+            RelayMessage(CInv(MSG_TX, hash), (CTransaction)*this, fFromMe);
         }
     }
 }
@@ -968,61 +1263,85 @@ void CWallet::ResendWalletTransactions()
 //
 
 
-int64 CWallet::GetBalance() const
+// Work out all three balances in one pass over the unspent transactions.
+// Confirmations and maturity only change with the best block, so the
+// totals are kept until it does or the wallet changes.
+void CWallet::CacheBalances() const
 {
-    int64 nTotal = 0;
+    if (fBalanceCached && pindexBalanceCached == pindexBest)
+        return;
+
+    nBalanceCached = 0;
+    nUnconfirmedBalanceCached = 0;
+    nImmatureBalanceCached = 0;
+    bool fAllFinal = true;
+    BOOST_FOREACH(const uint256& hash, setUnspent)
     {
-        LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsFinal() && pcoin->IsConfirmed())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+        map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+        const CWalletTx* pcoin = &(*it).second;
+        bool fFinal = pcoin->IsFinal();
+        if (fFinal && pcoin->IsConfirmed())
+            nBalanceCached += pcoin->GetAvailableCredit();
+        else
+            nUnconfirmedBalanceCached += pcoin->GetAvailableCredit();
+        if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() >= 2)
+            nImmatureBalanceCached += GetCredit(*pcoin);
+        fAllFinal &= fFinal;
     }
 
-    return nTotal;
+    // A lock time can pass without a new block, so don't keep totals
+    // that depend on one
+    fBalanceCached = fAllFinal;
+    pindexBalanceCached = pindexBest;
+}
+
+int64 CWallet::GetBalance() const
+{
+    LOCK(cs_wallet);
+    CacheBalances();
+    return nBalanceCached;
 }
 
 int64 CWallet::GetUnconfirmedBalance() const
 {
-    int64 nTotal = 0;
-    {
-        LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsFinal() || !pcoin->IsConfirmed())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK(cs_wallet);
+    CacheBalances();
+    return nUnconfirmedBalanceCached;
 }
 
 int64 CWallet::GetImmatureBalance() const
 {
-    int64 nTotal = 0;
-    {
-        LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx& pcoin = (*it).second;
-            if (pcoin.IsCoinBase() && pcoin.GetBlocksToMaturity() > 0 && pcoin.GetDepthInMainChain() >= 2)
-                nTotal += GetCredit(pcoin);
-        }
-    }
-    return nTotal;
+    LOCK(cs_wallet);
+    CacheBalances();
+    return nImmatureBalanceCached;
 }
 
 // populate vCoins with vector of spendable COutputs
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed) const
+{
+    uint256 hashLast;
+    AvailableCoins(vCoins, fOnlyConfirmed, NULL, 0, hashLast);
+}
+
+// Looks at up to nMaxTx (0 for all) of the unspent transactions in txid
+// order, from the one after *phashAfter if given.  hashLastRet is the last
+// looked at; returns whether there are more after it.
+bool CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const uint256* phashAfter, unsigned int nMaxTx, uint256& hashLastRet) const
 {
     vCoins.clear();
 
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        set<uint256>::const_iterator si = phashAfter ? setUnspent.upper_bound(*phashAfter) : setUnspent.begin();
+        hashLastRet = 0;
+        for (unsigned int n = 0; si != setUnspent.end() && (nMaxTx == 0 || n < nMaxTx); ++si, n++)
         {
+            hashLastRet = *si;
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(*si);
+            if (it == mapWallet.end())
+                continue;
             const CWalletTx* pcoin = &(*it).second;
 
             if (!pcoin->IsFinal())
@@ -1040,10 +1359,11 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed) const
                 if (!(pcoin->IsSpent(i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue >= nMinimumInputValue)
                     vCoins.push_back(COutput(pcoin, i, pcoin->GetDepthInMainChain()));
         }
+        return si != setUnspent.end();
     }
 }
 
-static void ApproximateBestSubset(vector<pair<int64, pair<const CWalletTx*,unsigned int> > >vValue, int64 nTotalLower, int64 nTargetValue,
+static void ApproximateBestSubset(const vector<pair<int64, pair<const CWalletTx*,unsigned int> > >& vValue, int64 nTotalLower, int64 nTargetValue,
                                   vector<char>& vfBest, int64& nBest, int iterations = 1000)
 {
     vector<char> vfIncluded;
@@ -1081,7 +1401,68 @@ static void ApproximateBestSubset(vector<pair<int64, pair<const CWalletTx*,unsig
     }
 }
 
-bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins,
+// Subset of vValue, which must be sorted biggest first, totalling at least
+// nTargetValue in as few coins as possible, and of those the smallest total.
+// Depth first branch and bound: including comes before leaving out, so the
+// first total found is the greedy one, whose count is the fewest there can
+// be.  A branch is dropped once it reaches the target, or when that many of
+// the biggest coins left can no longer reach it.  Coins of the same value
+// as one just left out are left out too, since they would only give the
+// same totals again.  Returns whether the search finished, so nBest is the
+// best there is, within nMaxTries steps.
+static bool SelectCoinsBnB(const vector<pair<int64, pair<const CWalletTx*,unsigned int> > >& vValue, int64 nTotalLower, int64 nTargetValue,
+                           vector<char>& vfBest, int64& nBest, int nMaxTries = 100000)
+{
+    vector<char> vfIncluded(vValue.size(), false);
+    vector<int64> vSum(1, 0);
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        vSum.push_back(vSum.back() + vValue[i].first);
+
+    vfBest.assign(vValue.size(), true);
+    nBest = nTotalLower;
+
+    // Coins before i are decided
+    unsigned int i = 0;
+    unsigned int nIncluded = 0;
+    unsigned int nMaxIncluded = vValue.size();
+    int64 nTotal = 0;
+    for (int nTries = 0; nTries < nMaxTries; nTries++)
+    {
+        if (nTotal < nTargetValue && nIncluded < nMaxIncluded &&
+            nTotal + vSum[min(i + nMaxIncluded - nIncluded, (unsigned int)vValue.size())] - vSum[i] >= nTargetValue)
+        {
+            nTotal += vValue[i].first;
+            vfIncluded[i++] = true;
+            nIncluded++;
+            continue;
+        }
+
+        if (nTotal >= nTargetValue)
+        {
+            nMaxIncluded = nIncluded;
+            if (nTotal < nBest)
+            {
+                nBest = nTotal;
+                vfBest = vfIncluded;
+                if (nBest == nTargetValue)
+                    return true;
+            }
+        }
+
+        // Back up to the last coin included and leave it out instead
+        while (i > 0 && !vfIncluded[i - 1])
+            i--;
+        if (i == 0)
+            return true;
+        vfIncluded[--i] = false;
+        nTotal -= vValue[i].first;
+        nIncluded--;
+        for (i++; i < vValue.size() && vValue[i].first == vValue[i - 1].first; i++) {}
+    }
+    return false;
+}
+
+bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, const vector<COutput>& vCoins,
                                  set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const
 {
     setCoinsRet.clear();
@@ -1091,12 +1472,11 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfThe
     pair<int64, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
     coinLowestLarger.first = std::numeric_limits<int64>::max();
     coinLowestLarger.second.first = NULL;
+    int nLowestLarger = 0;
     vector<pair<int64, pair<const CWalletTx*,unsigned int> > > vValue;
     int64 nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
-    BOOST_FOREACH(COutput output, vCoins)
+    BOOST_FOREACH(const COutput& output, vCoins)
     {
         const CWalletTx *pcoin = output.tx;
 
@@ -1108,13 +1488,7 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfThe
 
         pair<int64,pair<const CWalletTx*,unsigned int> > coin = make_pair(n,make_pair(pcoin, i));
 
-        if (n == nTargetValue)
-        {
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
-            return true;
-        }
-        else if (n < nTargetValue + CENT)
+        if (n < nTargetValue + CENT)
         {
             vValue.push_back(coin);
             nTotalLower += n;
@@ -1122,6 +1496,26 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfThe
         else if (n < coinLowestLarger.first)
         {
             coinLowestLarger = coin;
+            nLowestLarger = 1;
+        }
+        else if (n == coinLowestLarger.first && GetRandInt(++nLowestLarger) == 0)
+        {
+            // Any of the coins tied for it equally likely
+            coinLowestLarger = coin;
+        }
+    }
+
+    // Only the candidates are shuffled, so which of several equal coins
+    // gets picked is left to chance
+    random_shuffle(vValue.begin(), vValue.end(), GetRandInt);
+
+    for (unsigned int i = 0; i < vValue.size(); i++)
+    {
+        if (vValue[i].first == nTargetValue)
+        {
+            setCoinsRet.insert(vValue[i].second);
+            nValueRet += vValue[i].first;
+            return true;
         }
     }
 
@@ -1144,16 +1538,32 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfThe
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
+    // Solve subset sum by branch and bound.  When the search is cut short,
+    // stochastic approximation gets a try at a smaller total in no more coins
     sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
     int64 nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+    int64 nTarget = nTargetValue;
+    bool fDone = SelectCoinsBnB(vValue, nTotalLower, nTarget, vfBest, nBest);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+    {
+        nTarget = nTargetValue + CENT;
+        fDone = SelectCoinsBnB(vValue, nTotalLower, nTarget, vfBest, nBest);
+    }
+    if (!fDone)
+    {
+        vector<char> vfApprox;
+        int64 nApprox;
+        ApproximateBestSubset(vValue, nTotalLower, nTarget, vfApprox, nApprox, 100);
+        if (nApprox < nBest && count(vfApprox.begin(), vfApprox.end(), true) <= count(vfBest.begin(), vfBest.end(), true))
+        {
+            vfBest.swap(vfApprox);
+            nBest = nApprox;
+        }
+    }
 
-    // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
+    // If we have a bigger coin and (either the subset search didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
     if (coinLowestLarger.second.first &&
         ((nBest != nTargetValue && nBest < nTargetValue + CENT) || coinLowestLarger.first <= nBest))
@@ -1343,6 +1753,7 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
                 CWalletTx &coin = mapWallet[txin.prevout.hash];
                 coin.BindWallet(this);
                 coin.MarkSpent(txin.prevout.n);
+                UpdateUnspent(coin);
                 coin.WriteToDisk();
                 NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
             }
@@ -1366,6 +1777,155 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
     return true;
 }
 
+struct CompareOutputValue
+{
+    bool operator()(const COutput& a, const COutput& b) const
+    {
+        return a.tx->vout[a.i].nValue < b.tx->vout[b.i].nValue;
+    }
+};
+
+// The smallest of vCoins worth sweeping together, false if there aren't
+// enough of them to bother
+bool CWallet::SelectConsolidationCoins(const vector<COutput>& vCoins, vector<COutput>& vSweepRet) const
+{
+    vSweepRet.clear();
+    BOOST_FOREACH(const COutput& out, vCoins)
+        if (out.nDepth >= consolidation.nMinDepth && out.tx->vout[out.i].nValue < consolidation.nMaxInputValue)
+            vSweepRet.push_back(out);
+    if ((int)vSweepRet.size() < max(consolidation.nMinInputs, 2))
+    {
+        vSweepRet.clear();
+        return false;
+    }
+
+    sort(vSweepRet.begin(), vSweepRet.end(), CompareOutputValue());
+    if ((int)vSweepRet.size() > consolidation.nMaxInputs)
+        vSweepRet.resize(consolidation.nMaxInputs);
+    return true;
+}
+
+// Like CreateTransaction, but spends exactly vSweep into one new output of
+// our own, less the fee.  Fails if that would take more than
+// consolidation.nMaxFee.
+bool CWallet::CreateConsolidationTransaction(const vector<COutput>& vSweep, CWalletTx& wtxNew, CReserveKey& reservekey, int64& nFeeRet)
+{
+    int64 nValueIn = 0;
+    double dPriorityIn = 0;
+    BOOST_FOREACH(const COutput& out, vSweep)
+    {
+        int64 nCredit = out.tx->vout[out.i].nValue;
+        nValueIn += nCredit;
+        dPriorityIn += (double)nCredit * out.nDepth;
+    }
+    if (vSweep.empty())
+        return false;
+
+    wtxNew.BindWallet(this);
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        // txdb must be opened before the mapWallet lock
+        CTxDB txdb("r");
+
+        CScript scriptSweep;
+        scriptSweep.SetDestination(reservekey.GetReservedKey().GetID());
+
+        nFeeRet = nTransactionFee;
+        loop
+        {
+            if (nFeeRet > consolidation.nMaxFee || nFeeRet >= nValueIn)
+                return false;
+
+            wtxNew.vin.clear();
+            wtxNew.vout.clear();
+            wtxNew.fFromMe = true;
+            wtxNew.vout.push_back(CTxOut(nValueIn - nFeeRet, scriptSweep));
+            BOOST_FOREACH(const COutput& out, vSweep)
+                wtxNew.vin.push_back(CTxIn(out.tx->GetHash(), out.i));
+
+            // Sign
+            int nIn = 0;
+            BOOST_FOREACH(const COutput& out, vSweep)
+                if (!SignSignature(*this, *out.tx, wtxNew, nIn++))
+                    return false;
+
+            // Limit size
+            unsigned int nBytes = ::GetSerializeSize(*(CTransaction*)&wtxNew, SER_NETWORK, PROTOCOL_VERSION);
+            if (nBytes >= MAX_BLOCK_SIZE_GEN/5)
+                return false;
+            double dPriority = dPriorityIn / nBytes;
+
+            // Check that enough fee is included
+            int64 nPayFee = nTransactionFee * (1 + (int64)nBytes / 1000);
+            bool fAllowFree = CTransaction::AllowFree(dPriority);
+            int64 nMinFee = wtxNew.GetMinFee(1, fAllowFree, GMF_SEND);
+            if (nFeeRet < max(nPayFee, nMinFee))
+            {
+                nFeeRet = max(nPayFee, nMinFee);
+                continue;
+            }
+
+            // Fill vtxPrev by copying from previous transactions vtxPrev
+            wtxNew.AddSupportingTransactions(txdb);
+            wtxNew.fTimeReceivedIsTxTime = true;
+
+            break;
+        }
+    }
+    return true;
+}
+
+// Sweeps the smallest outputs of ours together into one, when the policy
+// allows: no more than once every consolidation.nInterval, one sweep in
+// flight at a time, and only while the memory pool is quiet.  Called
+// every so often from the message handler thread.
+void CWallet::ConsolidateCoins()
+{
+    LOCK2(cs_main, cs_wallet);
+    if (!consolidation.fEnabled || GetTime() < nNextConsolidationCheck)
+        return;
+    nNextConsolidationCheck = GetTime() + 60;
+
+    if (IsInitialBlockDownload() || IsLocked())
+        return;
+    if (mempool.size() > consolidation.nMaxPoolTx)
+        return;
+    if (GetTime() < nLastConsolidationTime + consolidation.nInterval)
+        return;
+
+    // Don't chain sweeps on unconfirmed ones
+    if (hashLastConsolidation != 0 && mempool.exists(hashLastConsolidation))
+        return;
+
+    vector<COutput> vCoins, vSweep;
+    AvailableCoins(vCoins);
+    if (!SelectConsolidationCoins(vCoins, vSweep))
+        return;
+
+    // Whatever happens, that counts as a go
+    nLastConsolidationTime = GetTime();
+
+    CWalletTx wtx;
+    CReserveKey reservekey(this);
+    int64 nFee;
+    if (!CreateConsolidationTransaction(vSweep, wtx, reservekey, nFee))
+    {
+        printf("ConsolidateCoins() : couldn't sweep %d outputs for a fee of at most %s\n",
+               (int)vSweep.size(), FormatMoney(consolidation.nMaxFee).c_str());
+        return;
+    }
+    if (!CommitTransaction(wtx, reservekey))
+        return;
+
+    hashLastConsolidation = wtx.GetHash();
+    nConsolidations++;
+    nConsolidatedInputs += vSweep.size();
+    printf("ConsolidateCoins() : swept %d outputs into %s worth %s, fee %s\n",
+           (int)vSweep.size(), hashLastConsolidation.ToString().substr(0,10).c_str(),
+           FormatMoney(wtx.vout[0].nValue).c_str(), FormatMoney(nFee).c_str());
+}
+
 
 
 
@@ -1426,6 +1986,7 @@ int CWallet::LoadWallet(bool& fFirstRunRet)
         return false;
     fFirstRunRet = false;
     int nLoadWalletRet = CWalletDB(strWalletFile,"cr+").LoadWallet(this);
+    ReindexUnspent();
     if (nLoadWalletRet == DB_NEED_REWRITE)
     {
         if (CDB::Rewrite(strWalletFile, "\x04pool"))
@@ -1447,11 +2008,29 @@ int CWallet::LoadWallet(bool& fFirstRunRet)
 }
 
 
+// Transactions paying address are listed under its label, so they move
+// with it
+void CWallet::RelabelAccountTxs(const CTxDestination& address, const string* pstrName)
+{
+    LOCK(cs_wallet);
+    vector<uint256> vHash;
+    map<CTxDestination, set<uint256> >::const_iterator mi = mapAddressTx.find(address);
+    if (mi != mapAddressTx.end())
+        vHash.assign((*mi).second.begin(), (*mi).second.end());
+    if (pstrName)
+        mapAddressBook[address] = *pstrName;
+    else
+        mapAddressBook.erase(address);
+    BOOST_FOREACH(const uint256& hash, vHash)
+        IndexAccountTx(mapWallet[hash]);
+}
+
 bool CWallet::SetAddressBookName(const CTxDestination& address, const string& strName)
 {
     std::map<CTxDestination, std::string>::iterator mi = mapAddressBook.find(address);
-    mapAddressBook[address] = strName;
-    NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address), (mi == mapAddressBook.end()) ? CT_NEW : CT_UPDATED);
+    bool fNew = (mi == mapAddressBook.end());
+    RelabelAccountTxs(address, &strName);
+    NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address), fNew ? CT_NEW : CT_UPDATED);
     if (!fFileBacked)
         return false;
     return CWalletDB(strWalletFile).WriteName(CBitcoinAddress(address).ToString(), strName);
@@ -1459,7 +2038,7 @@ bool CWallet::SetAddressBookName(const CTxDestination& address, const string& st
 
 bool CWallet::DelAddressBookName(const CTxDestination& address)
 {
-    mapAddressBook.erase(address);
+    RelabelAccountTxs(address, NULL);
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address), CT_DELETED);
     if (!fFileBacked)
         return false;
@@ -16,6 +16,11 @@ class CWalletTx;
 class CReserveKey;
 class CWalletDB;
 class COutput;
+class CAccountingEntry;
+
+// Transactions this deep count towards account balances at any minconf up
+// to it, and are taken to stay put.  Well past coinbase maturity.
+static const int ACCOUNT_SETTLED_DEPTH = 120;
 
 /** (client) version numbers for particular wallet features */
 enum WalletFeature
@@ -56,6 +61,39 @@ public:
     )
 };
 
+/** When and how a wallet sweeps its small outputs together (see
+ * CWallet::ConsolidateCoins), so later payments need fewer inputs.
+ */
+class CConsolidationPolicy
+{
+public:
+    bool fEnabled;
+    int64 nMaxInputValue;     // outputs worth less than this are swept
+    int nMinInputs;           // fewer of them aren't worth a transaction
+    int nMaxInputs;           // per sweep, small enough to go free when old enough
+    int nMinDepth;            // only outputs at least this deep
+    int64 nMaxFee;            // skip a sweep that would need a bigger fee
+    int64 nInterval;          // seconds from one sweep to the next, at least
+    unsigned int nMaxPoolTx;  // only while the memory pool holds no more
+
+    CConsolidationPolicy()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        fEnabled = false;
+        nMaxInputValue = COIN;
+        nMinInputs = 20;
+        nMaxInputs = 50;
+        nMinDepth = 6;
+        nMaxFee = CENT;
+        nInterval = 60 * 60;
+        nMaxPoolTx = 100;
+    }
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -72,6 +110,54 @@ private:
     // the maximum wallet format version: memory-only variable that specifies to what version this wallet may be upgraded
     int nWalletMaxVersion;
 
+    // Transactions with outputs of ours that aren't spent yet, kept up to
+    // date as mapWallet changes so balances and coin selection only need
+    // to look at these
+    std::set<uint256> setUnspent;
+
+    // Balances worked out from setUnspent, good until the best block changes
+    mutable bool fBalanceCached;
+    mutable const CBlockIndex* pindexBalanceCached;
+    mutable int64 nBalanceCached;
+    mutable int64 nUnconfirmedBalanceCached;
+    mutable int64 nImmatureBalanceCached;
+
+    void CacheBalances() const;
+
+    // Where a wallet transaction is in the account index
+    struct CAccountTx
+    {
+        int64 nTime;
+        std::vector<std::string> vAccount; // accounts it is listed under
+        std::vector<CTxDestination> vReceived; // our addresses it pays, change included
+        bool fSettled;
+        std::vector<std::pair<std::string, int64> > vSettled; // what it added to mapAccountSettled
+    };
+
+    // Accounting entries, which never change once written
+    std::list<CAccountingEntry> laccentries;
+
+    // Transactions and accounting entries by time under each account, and
+    // all of them under "*", so listing the latest few doesn't sort the
+    // whole wallet
+    std::map<std::string, std::multimap<int64, std::pair<CWalletTx*, CAccountingEntry*> > > mapAccountItems;
+    std::map<uint256, CAccountTx> mapAccountTx;
+    // Transactions paying each of our addresses, to move when it is
+    // relabelled and to tally what it received
+    std::map<CTxDestination, std::set<uint256> > mapAddressTx;
+
+    // Running balance of each account from its accounting entries and its
+    // transactions at least ACCOUNT_SETTLED_DEPTH deep; the rest are
+    // tallied when asked for
+    std::map<std::string, int64> mapAccountSettled;
+    std::set<uint256> setAccountUnsettled;
+
+    void IndexAccountTx(CWalletTx& wtx);
+    void UnindexAccountTx(const uint256& hash);
+    void IndexAccountingEntry(CAccountingEntry& acentry);
+    void SettleAccountTxs();
+    void RelabelAccountTxs(const CTxDestination& address, const std::string* pstrName);
+
 public:
     mutable CCriticalSection cs_wallet;
 
@@ -92,6 +178,13 @@ public:
         fFileBacked = false;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
+        fBalanceCached = false;
+        pindexBalanceCached = NULL;
+        nConsolidations = 0;
+        nConsolidatedInputs = 0;
+        hashLastConsolidation = 0;
+        nLastConsolidationTime = 0;
+        nNextConsolidationCheck = 0;
     }
     CWallet(std::string strWalletFileIn)
     {
@@ -101,11 +194,26 @@ public:
         fFileBacked = true;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
+        fBalanceCached = false;
+        pindexBalanceCached = NULL;
+        nConsolidations = 0;
+        nConsolidatedInputs = 0;
+        hashLastConsolidation = 0;
+        nLastConsolidationTime = 0;
+        nNextConsolidationCheck = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
     std::map<uint256, int> mapRequestCount;
 
+    // Sweeping small outputs together, and how it has gone so far
+    CConsolidationPolicy consolidation;
+    int nConsolidations;
+    int nConsolidatedInputs;
+    uint256 hashLastConsolidation;
+    int64 nLastConsolidationTime;
+    int64 nNextConsolidationCheck;
+
     std::map<CTxDestination, std::string> mapAddressBook;
 
     CPubKey vchDefaultKey;
@@ -114,7 +222,8 @@ public:
     bool CanSupportFeature(enum WalletFeature wf) { return nWalletMaxVersion >= wf; }
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true) const;
-    bool SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
+    bool AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed, const uint256* phashAfter, unsigned int nMaxTx, uint256& hashLastRet) const;
+    bool SelectCoinsMinConf(int64 nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
 
     // keystore implementation
     // Generate a new key
@@ -138,6 +247,24 @@ public:
     bool EncryptWallet(const SecureString& strWalletPassphrase);
 
     void MarkDirty();
+    // Bring setUnspent up to date after wtx was added or had outputs spent
+    void UpdateUnspent(const CWalletTx& wtx);
+    void ReindexUnspent();
+
+    typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
+    typedef std::multimap<int64, TxPair> TxItems;
+
+    // Record an accounting entry that has been written to the database
+    void AddAccountingEntry(const CAccountingEntry& acentry);
+    void ReindexAccounts();
+    // Transactions and accounting entries listed under strAccount ("*" for
+    // all) by time; cs_wallet must be held while using them
+    const TxItems& GetAccountItems(const std::string& strAccount) const;
+    int64 GetAccountBalance(const std::string& strAccount, int nMinDepth);
+    void GetAccountBalances(std::map<std::string, int64>& mapBalances, int nMinDepth);
+    // Received by one of our addresses in transactions at least nMinDepth
+    // deep, and the depth of the shallowest of them
+    int64 GetAddressReceived(const CTxDestination& address, int nMinDepth, int& nConfRet) const;
     bool AddToWallet(const CWalletTx& wtxIn);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate = false, bool fFindBlock = false);
     bool EraseFromWallet(uint256 hash);
@@ -153,6 +280,9 @@ public:
     bool CreateTransaction(const std::vector<std::pair<CScript, int64> >& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, int64& nFeeRet);
     bool CreateTransaction(CScript scriptPubKey, int64 nValue, CWalletTx& wtxNew, CReserveKey& reservekey, int64& nFeeRet);
     bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey);
+    bool SelectConsolidationCoins(const std::vector<COutput>& vCoins, std::vector<COutput>& vSweepRet) const;
+    bool CreateConsolidationTransaction(const std::vector<COutput>& vSweep, CWalletTx& wtxNew, CReserveKey& reservekey, int64& nFeeRet);
+    void ConsolidateCoins();
     std::string SendMoney(CScript scriptPubKey, int64 nValue, CWalletTx& wtxNew, bool fAskFee=false);
     std::string SendMoneyToDestination(const CTxDestination &address, int64 nValue, CWalletTx& wtxNew, bool fAskFee=false);
 
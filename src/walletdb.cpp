@@ -200,6 +200,11 @@ int CWalletDB::LoadWallet(CWallet* pwallet)
                 ssKey >> nNumber;
                 if (nNumber > nAccountingEntryNumber)
                     nAccountingEntryNumber = nNumber;
+
+                CAccountingEntry acentry;
+                acentry.strAccount = strAccount;
+                ssValue >> acentry;
+                pwallet->AddAccountingEntry(acentry);
             }
             else if (strType == "key" || strType == "wkey")
             {
@@ -0,0 +1,82 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <deque>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/** Bounded first in, first out queue of jobs for a pool of worker threads.
+  *
+  * Producers never wait: Push() refuses a job once nMaxDepth are waiting,
+  * so the caller can turn the request away instead of letting the backlog
+  * grow without limit.  Workers block in Pop() until there is a job, or
+  * until Interrupt() tells them all to exit.
+  */
+template<typename T> class CWorkQueue
+{
+private:
+    // Mutex to protect the inner state
+    boost::mutex mutex;
+
+    // Workers block on this when out of work
+    boost::condition_variable cond;
+
+    std::deque<T> queue;
+    unsigned int nMaxDepth;
+    bool fQuit;
+
+public:
+    CWorkQueue(unsigned int nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fQuit(false) {}
+
+    // Add a job, unless the queue is full or interrupted
+    bool Push(const T& job)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fQuit || queue.size() >= nMaxDepth)
+                return false;
+            queue.push_back(job);
+        }
+        cond.notify_one();
+        return true;
+    }
+
+    // Wait for the oldest job; false once the queue has been interrupted
+    bool Pop(T& job)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fQuit && queue.empty())
+            cond.wait(lock);
+        if (fQuit)
+            return false;
+        job = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
+    // Drop the waiting jobs and wake every worker to exit
+    void Interrupt()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fQuit = true;
+            queue.clear();
+        }
+        cond.notify_all();
+    }
+
+    unsigned int Depth()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return queue.size();
+    }
+
+    unsigned int MaxDepth() const { return nMaxDepth; }
+};
+
+#endif